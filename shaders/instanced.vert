@@ -0,0 +1,15 @@
+#version 450
+
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec3 inColor;
+
+layout(location = 2) in vec2 instanceOffset;
+layout(location = 3) in vec2 instanceScale;
+layout(location = 4) in vec3 instanceColor;
+
+layout(location = 0) out vec3 fragColor;
+
+void main() {
+    gl_Position = vec4(inPosition * instanceScale + instanceOffset, 0.0, 1.0);
+    fragColor = inColor * instanceColor;
+}
@@ -0,0 +1,423 @@
+#ifndef ALLOCATOR_H_
+#define ALLOCATOR_H_
+
+#include "hostmemory.hpp"
+#include "memorytypes.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+/**
+ * How a request is carved out of device memory.
+ * Buddy: power of two splits of a large block, the general purpose path.
+ * Pool: equally sized slots, for swarms of small buffers.
+ * Dedicated: a vkAllocateMemory of its own, for the really big stuff.
+ * Auto picks one of the above from the size.
+ * */
+enum class Strategy { Auto, Buddy, Pool, Dedicated };
+
+struct MemoryBlock;
+
+/* A piece of device memory handed out by the Allocator. */
+struct Memory {
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  VkDeviceSize offset = 0;
+  VkDeviceSize size = 0;
+  /* Only set for host visible memory, which stays mapped for its lifetime. */
+  void *mapped = nullptr;
+  uint32_t memoryType = 0;
+  MemoryBlock *block = nullptr;
+  /* Buddy order or pool slot size, depending on the block. */
+  VkDeviceSize detail = 0;
+};
+
+struct MemoryBlock {
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  VkDeviceSize size = 0;
+  void *mapped = nullptr;
+  uint32_t memoryType = 0;
+  /* Buffers and optimally tiled images never share a block, which keeps
+   * bufferImageGranularity out of the picture. */
+  bool optimal = false;
+  Strategy strategy = Strategy::Buddy;
+  uint32_t allocations = 0;
+
+  /* Buddy: free offsets per order. */
+  std::vector<std::set<VkDeviceSize>> freeLists;
+  /* Pool: slot size and free slots. */
+  VkDeviceSize slotSize = 0;
+  std::vector<VkDeviceSize> freeSlots;
+};
+
+class Allocator {
+public:
+  static constexpr VkDeviceSize BLOCK_SIZE = 64ull << 20;
+  static constexpr VkDeviceSize MIN_ALLOCATION = 256;
+  static constexpr VkDeviceSize POOL_BLOCK_SIZE = 4ull << 20;
+  static constexpr VkDeviceSize MAX_POOL_SLOT = 64ull << 10;
+
+  /* `budget`: VK_EXT_memory_budget is enabled on the device. */
+  void create(const VkDevice &device, const VkPhysicalDevice &physicalDevice,
+              bool budget) {
+    this->device = device;
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    maxAllocations = properties.limits.maxMemoryAllocationCount;
+    types.create(physicalDevice, budget);
+  }
+
+  /* Allocates and binds memory for a buffer. */
+  Memory allocate(const VkBuffer &buffer, const MemoryRequest &request,
+                  Strategy strategy = Strategy::Auto) {
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(device, buffer, &requirements);
+    Memory memory = allocate(requirements, request, false, strategy);
+    vkBindBufferMemory(device, buffer, memory.memory, memory.offset);
+    return memory;
+  }
+
+  /* Allocates and binds memory for an optimally tiled image. */
+  Memory allocate(const VkImage &image, const MemoryRequest &request,
+                  Strategy strategy = Strategy::Auto) {
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements(device, image, &requirements);
+    Memory memory = allocate(requirements, request, true, strategy);
+    vkBindImageMemory(device, image, memory.memory, memory.offset);
+    return memory;
+  }
+
+  Memory allocate(VkMemoryRequirements requirements,
+                  const MemoryRequest &request, bool optimal,
+                  Strategy strategy) {
+    std::lock_guard<std::mutex> lock(mutex);
+    VkDeviceSize size = std::max(requirements.size, requirements.alignment);
+
+    if (strategy == Strategy::Auto) {
+      if (size <= MAX_POOL_SLOT) {
+        strategy = Strategy::Pool;
+      } else if (size <= BLOCK_SIZE / 2) {
+        strategy = Strategy::Buddy;
+      } else {
+        strategy = Strategy::Dedicated;
+      }
+    }
+    /* An explicit strategy still has to fit its blocks, bigger requests move
+     * on to the next one that does. */
+    if (strategy == Strategy::Pool && size > MAX_POOL_SLOT) {
+      strategy = Strategy::Buddy;
+    }
+    if (strategy == Strategy::Buddy && size > BLOCK_SIZE) {
+      strategy = Strategy::Dedicated;
+    }
+
+    /* What a new block costs the heap, which is all the budget cares about;
+     * room in a block we already hold is free. */
+    VkDeviceSize blockSize = strategy == Strategy::Pool    ? POOL_BLOCK_SIZE
+                             : strategy == Strategy::Buddy ? BLOCK_SIZE
+                                                           : requirements.size;
+    std::vector<uint32_t> candidates =
+        types.ranked(requirements.memoryTypeBits, request);
+    Memory memory;
+    for (uint32_t memoryType : candidates) {
+      if (reuse(size, memoryType, optimal, strategy, memory)) {
+        return memory;
+      }
+      if (types.fits(memoryType, blockSize)) {
+        return fresh(requirements, size, memoryType, optimal, strategy);
+      }
+    }
+    types.overBudget();
+    return fresh(requirements, size, candidates.front(), optimal, strategy);
+  }
+
+  void free(Memory &memory) {
+    std::lock_guard<std::mutex> lock(mutex);
+    MemoryBlock *block = memory.block;
+    if (block == nullptr) {
+      return;
+    }
+    block->allocations--;
+
+    switch (block->strategy) {
+    case Strategy::Pool:
+      block->freeSlots.push_back(memory.offset);
+      break;
+    case Strategy::Buddy:
+      freeBuddy(*block, memory.offset, memory.detail);
+      break;
+    default:
+      break;
+    }
+
+    if (block->allocations == 0) {
+      release(block);
+    }
+    memory = {};
+  }
+
+  void report(std::ostream &out) const {
+    VkDeviceSize reserved = 0;
+    uint32_t handed = 0;
+    for (const auto &block : blocks) {
+      reserved += block->size;
+      handed += block->allocations;
+    }
+    out << "[VkMemory]: " << handed << " allocations in " << blocks.size()
+        << " device allocations (limit " << maxAllocations << "), "
+        << (reserved >> 10) << " KiB reserved." << std::endl;
+    types.report(out);
+  }
+
+  /* Large static data can skip staging, see MemoryTypes::directWrites. */
+  bool directWrites() const { return types.directWrites(); }
+
+  /* The CPU can write `memory` and the GPU sees it without a flush. */
+  bool writable(const Memory &memory) const {
+    return memory.mapped != nullptr &&
+           (types.flags(memory.memoryType) &
+            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  }
+
+  void clean() {
+    for (auto &block : blocks) {
+      vkFreeMemory(device, block->memory, HostMemory::callbacks());
+    }
+    blocks.clear();
+  }
+
+private:
+  MemoryBlock *createBlock(VkDeviceSize size, uint32_t memoryType,
+                           bool optimal, Strategy strategy) {
+    if (blocks.size() >= maxAllocations) {
+      throw std::runtime_error(
+          "[VkMemory]: The driver won't give me another allocation.");
+    }
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = size;
+    allocInfo.memoryTypeIndex = memoryType;
+
+    auto block = std::make_unique<MemoryBlock>();
+    if (vkAllocateMemory(device, &allocInfo, HostMemory::callbacks(),
+                         &block->memory) != VK_SUCCESS) {
+      throw std::runtime_error(
+          "[VkMemory]: Oh boy, I can't allocate my memory!");
+    }
+    /* Map host visible blocks once and keep them mapped. */
+    if ((types.flags(memoryType) & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) &&
+        vkMapMemory(device, block->memory, 0, size, 0, &block->mapped) !=
+            VK_SUCCESS) {
+      vkFreeMemory(device, block->memory, HostMemory::callbacks());
+      throw std::runtime_error(
+          "[VkMemory]: Host visible, they said. Can't map it, I say.");
+    }
+    block->size = size;
+    block->memoryType = memoryType;
+    block->optimal = optimal;
+    block->strategy = strategy;
+    types.track(memoryType, size, true);
+
+    blocks.push_back(std::move(block));
+    return blocks.back().get();
+  }
+
+  void release(MemoryBlock *block) {
+    /* Keep one empty block of each kind around to avoid churn. */
+    auto spare = std::count_if(
+        blocks.begin(), blocks.end(), [block](const auto &other) {
+          return other.get() != block && other->allocations == 0 &&
+                 other->strategy == block->strategy &&
+                 other->memoryType == block->memoryType &&
+                 other->optimal == block->optimal &&
+                 other->slotSize == block->slotSize;
+        });
+    if (spare == 0 && block->strategy != Strategy::Dedicated) {
+      return;
+    }
+    vkFreeMemory(device, block->memory, HostMemory::callbacks());
+    types.track(block->memoryType, block->size, false);
+    blocks.erase(std::find_if(
+        blocks.begin(), blocks.end(),
+        [block](const auto &other) { return other.get() == block; }));
+  }
+
+  static Memory handle(MemoryBlock *block, VkDeviceSize offset,
+                       VkDeviceSize size, VkDeviceSize detail) {
+    Memory memory;
+    memory.memory = block->memory;
+    memory.offset = offset;
+    memory.size = size;
+    memory.memoryType = block->memoryType;
+    memory.block = block;
+    memory.detail = detail;
+    if (block->mapped != nullptr) {
+      memory.mapped = static_cast<char *>(block->mapped) + offset;
+    }
+    block->allocations++;
+    return memory;
+  }
+
+  Memory allocateDedicated(VkDeviceSize size, uint32_t memoryType,
+                           bool optimal) {
+    MemoryBlock *block =
+        createBlock(size, memoryType, optimal, Strategy::Dedicated);
+    return handle(block, 0, size, 0);
+  }
+
+  /* Serves the request from a block of `memoryType` we already hold. */
+  bool reuse(VkDeviceSize size, uint32_t memoryType, bool optimal,
+             Strategy strategy, Memory &memory) {
+    switch (strategy) {
+    case Strategy::Pool:
+      return reusePool(size, memoryType, optimal, memory);
+    case Strategy::Buddy:
+      return reuseBuddy(size, memoryType, optimal, memory);
+    default:
+      return false;
+    }
+  }
+
+  /* Serves the request from a new block of `memoryType`. */
+  Memory fresh(const VkMemoryRequirements &requirements, VkDeviceSize size,
+               uint32_t memoryType, bool optimal, Strategy strategy) {
+    switch (strategy) {
+    case Strategy::Pool:
+      return createPool(size, memoryType, optimal);
+    case Strategy::Buddy:
+      return createBuddy(size, memoryType, optimal);
+    default:
+      return allocateDedicated(requirements.size, memoryType, optimal);
+    }
+  }
+
+  /* Slot sizes are powers of two, so every slot is aligned to its size. */
+  static VkDeviceSize slotFor(VkDeviceSize size) {
+    VkDeviceSize slot = MIN_ALLOCATION;
+    while (slot < size) {
+      slot <<= 1;
+    }
+    return slot;
+  }
+
+  bool reusePool(VkDeviceSize size, uint32_t memoryType, bool optimal,
+                 Memory &memory) {
+    VkDeviceSize slot = slotFor(size);
+    for (auto &block : blocks) {
+      if (block->strategy == Strategy::Pool &&
+          block->memoryType == memoryType && block->optimal == optimal &&
+          block->slotSize == slot && !block->freeSlots.empty()) {
+        VkDeviceSize offset = block->freeSlots.back();
+        block->freeSlots.pop_back();
+        memory = handle(block.get(), offset, size, slot);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  Memory createPool(VkDeviceSize size, uint32_t memoryType, bool optimal) {
+    VkDeviceSize slotSize = slotFor(size);
+    MemoryBlock *block =
+        createBlock(POOL_BLOCK_SIZE, memoryType, optimal, Strategy::Pool);
+    block->slotSize = slotSize;
+    for (VkDeviceSize offset = POOL_BLOCK_SIZE; offset > 0;
+         offset -= slotSize) {
+      block->freeSlots.push_back(offset - slotSize);
+    }
+    VkDeviceSize offset = block->freeSlots.back();
+    block->freeSlots.pop_back();
+    return handle(block, offset, size, slotSize);
+  }
+
+  /* Orders count up from MIN_ALLOCATION, a block is one free max order. */
+  static uint32_t orderFor(VkDeviceSize size) {
+    uint32_t order = 0;
+    while ((MIN_ALLOCATION << order) < size) {
+      order++;
+    }
+    return order;
+  }
+
+  bool reuseBuddy(VkDeviceSize size, uint32_t memoryType, bool optimal,
+                  Memory &memory) {
+    uint32_t order = orderFor(size);
+    for (auto &block : blocks) {
+      if (block->strategy == Strategy::Buddy &&
+          block->memoryType == memoryType && block->optimal == optimal) {
+        VkDeviceSize offset;
+        if (splitBuddy(*block, order, offset)) {
+          memory = handle(block.get(), offset, size, order);
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  Memory createBuddy(VkDeviceSize size, uint32_t memoryType, bool optimal) {
+    uint32_t order = orderFor(size);
+    MemoryBlock *block =
+        createBlock(BLOCK_SIZE, memoryType, optimal, Strategy::Buddy);
+    uint32_t maxOrder = 0;
+    while ((MIN_ALLOCATION << maxOrder) < BLOCK_SIZE) {
+      maxOrder++;
+    }
+    block->freeLists.resize(maxOrder + 1);
+    block->freeLists[maxOrder].insert(0);
+    VkDeviceSize offset;
+    if (!splitBuddy(*block, order, offset)) {
+      throw std::runtime_error(
+          "[VkMemory]: A fresh block can't hold that, how did it get here?");
+    }
+    return handle(block, offset, size, order);
+  }
+
+  static bool splitBuddy(MemoryBlock &block, uint32_t order,
+                         VkDeviceSize &offset) {
+    uint32_t found = order;
+    while (found < block.freeLists.size() && block.freeLists[found].empty()) {
+      found++;
+    }
+    if (found >= block.freeLists.size()) {
+      return false;
+    }
+    offset = *block.freeLists[found].begin();
+    block.freeLists[found].erase(block.freeLists[found].begin());
+    /* Hand the upper halves back until the piece is just big enough. */
+    while (found > order) {
+      found--;
+      block.freeLists[found].insert(offset + (MIN_ALLOCATION << found));
+    }
+    return true;
+  }
+
+  static void freeBuddy(MemoryBlock &block, VkDeviceSize offset,
+                        VkDeviceSize order) {
+    while (order + 1 < block.freeLists.size()) {
+      VkDeviceSize buddy = offset ^ (MIN_ALLOCATION << order);
+      auto it = block.freeLists[order].find(buddy);
+      if (it == block.freeLists[order].end()) {
+        break;
+      }
+      block.freeLists[order].erase(it);
+      offset = std::min(offset, buddy);
+      order++;
+    }
+    block.freeLists[order].insert(offset);
+  }
+
+  VkDevice device = VK_NULL_HANDLE;
+  MemoryTypes types;
+  uint32_t maxAllocations = 4096;
+  std::vector<std::unique_ptr<MemoryBlock>> blocks;
+  std::mutex mutex;
+};
+
+#endif // ALLOCATOR_H_
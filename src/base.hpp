@@ -1,13 +1,30 @@
 #ifndef BASE_H_
 #define BASE_H_
 
-#include "allocation.hpp"
+#include "allocator.hpp"
+#include "batcher.hpp"
 #include "buffers.hpp"
 #include "commands.hpp"
+#include "deletions.hpp"
+#include "frames.hpp"
+#include "geometry.hpp"
+#include "hostmemory.hpp"
+#include "indirect.hpp"
+#include "meshopt.hpp"
+#include "offscreen.hpp"
 #include "pipeline.hpp"
+#include "pipelinecache.hpp"
+#include "profiler.hpp"
+#include "quantize.hpp"
+#include "recorder.hpp"
+#include "recordings.hpp"
 #include "renderpass.hpp"
 #include "swapchain.hpp"
+#include "timeline.hpp"
+#include "uploads.hpp"
 #include "vertex.hpp"
+#include <chrono>
+#include <cmath>
 #include <cstddef>
 #include <cstdint>
 #include <vector>
@@ -34,8 +51,12 @@ namespace App {
 class VkApp {
 
 public:
+  explicit VkApp(const Options &options) : options(options) {}
+
   void run() {
-    initWindow();
+    if (!options.headless) {
+      initWindow();
+    }
     initContext();
     loop();
     clean();
@@ -46,130 +67,407 @@ private:
   void initWindow() {
     glfwInit();
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-    glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
     window = glfwCreateWindow(WIDTH, HEIGHT, "explorer", nullptr, nullptr);
+    glfwSetWindowUserPointer(window, this);
+    glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+  }
+
+  static void framebufferResizeCallback(GLFWwindow *window, int /*width*/,
+                                        int /*height*/) {
+    auto app = reinterpret_cast<VkApp *>(glfwGetWindowUserPointer(window));
+    app->framebufferResized = true;
   }
   // Allocate resources
   void initContext() {
+    /* Before anything the driver could allocate for. */
+    if (options.hostAllocator) {
+      HostMemory::enable();
+    }
     createInstance();
     setupDebugMessenger();
-    createSurface();
+    if (!options.headless) {
+      createSurface();
+    }
     physicalDevice.pick(instance, surface);
     device.createLogicalDevice(physicalDevice, surface);
-    SwapChain::create(window, physicalDevice.get(), surface, device.get(),
-                      &swapChain, swapChainImages, swapChainImageFormat,
-                      swapChainExtent);
+    timeline.create(device.get());
+    allocator.create(device.get(), physicalDevice.get(),
+                     physicalDevice.memoryBudget());
+    deletions.create(device.get(), allocator, timeline);
+    profiler.create(device.get(), physicalDevice.get(),
+                    QueueFamilyIndices::find(physicalDevice.get(), surface)
+                        .graphicsFamily.value(),
+                    options.framesInFlight);
+    profiler.traceAll(!options.tracePath.empty());
+    uploader.create(device.get(), allocator, device.transferFamily(),
+                    device.tQueue(), device.graphicsFamily(), device.gQueue(),
+                    timeline, profiler);
+    if (options.headless) {
+      /* One target per frame slot, nothing else competes for them. */
+      Offscreen::create(device.get(), allocator, options.framesInFlight, swapChainImages,
+                        offscreenMemory, swapChainImageFormat,
+                        swapChainExtent);
+    } else {
+      SwapChain::create(window, physicalDevice.get(), surface, device.get(),
+                        &swapChain, swapChainImages, swapChainImageFormat,
+                        swapChainExtent);
+    }
     createImageViews();
-    RenderPass::create(device.get(), swapChainImageFormat, renderPass);
-    Pipeline::create(device.get(), swapChainExtent, pipelineLayout, renderPass,
-                     graphicsPipeline);
+    /* Offscreen frames end up ready to be copied out. */
+    RenderPass::create(device.get(), swapChainImageFormat, renderPass,
+                       options.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+                                        : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+    pipelineCache.create(device.get(), physicalDevice.get(),
+                         options.pipelineCachePath);
+    auto pipelineStart = std::chrono::steady_clock::now();
+    Pipeline::create(device.get(), pipelineCache.get(), pipelineLayout,
+                     renderPass, graphicsPipeline);
+    if (options.instances > 0) {
+      Pipeline::createInstanced(device.get(), pipelineCache.get(),
+                                instancedLayout, renderPass,
+                                instancedPipeline);
+    }
+    if (options.compact) {
+      Pipeline::createPacked(device.get(), pipelineCache.get(), packedLayout,
+                             renderPass, packedPipeline);
+    }
+    std::chrono::duration<double, std::milli> pipelineTime =
+        std::chrono::steady_clock::now() - pipelineStart;
+    std::cout << "[VkPipelineCache]: Pipelines built in "
+              << pipelineTime.count() << " ms ("
+              << (pipelineCache.isWarm() ? "warm" : "cold") << ")."
+              << std::endl;
     FrameBuffers::create(device.get(), renderPass, swapChainFramebuffers,
                          swapChainImageViews, swapChainExtent);
-    Commands::createPool(physicalDevice.get(), surface, device.get(),
-                         commandPool);
-    VertexBuffers::create(device.get(), physicalDevice.get(), vertexBuffer,
-                          vertexBufferMemory, vertices, data, commandPool,
-                          device.gQueue());
-    IndexBuffers::create(device.get(), physicalDevice.get(), indexBuffer,
-                          indexBufferMemory, indices, index_data, commandPool,
-                          device.gQueue());
-    Commands::createBuffers(device.get(), commandPool, commandBuffer);
-    createSyncObjects();
+    MeshOptimizer::optimize(
+        vertices, indices,
+        [](const Vertex &vertex) {
+          return glm::vec3(vertex.pos.x, vertex.pos.y, 0.0f);
+        },
+        std::cout);
+    geometry.create(device.get(), allocator, uploader, GEOMETRY_VERTEX_BYTES,
+                    GEOMETRY_INDICES);
+    mesh = geometry.add(vertices, indices);
+    if (options.compact) {
+      packedMesh = geometry.add(Quantize::pack(vertices), indices);
+    }
+    if (options.quantizeBenchmark) {
+      Quantize::benchmark(std::cout, QUANTIZE_BENCHMARK_VERTICES);
+    }
+    /* All of it lands in one submit. Frames go on the same queue after it, so the
+     * upload barrier covers them and nobody has to wait here. */
+    uploader.flush();
+    Frames::create(device.get(), frames, options.framesInFlight);
+    auto images = static_cast<uint32_t>(swapChainImages.size());
+    /* Zero draws leave nothing to compact, nor a buffer to compact into. */
+    useIndirect =
+        options.indirect && options.draws > 0 && device.multiDrawIndirect();
+    if (options.indirect && options.draws > 0 && !useIndirect) {
+      std::cout << "[VkApp]: No multiDrawIndirect here, drawing through the "
+                   "render queue instead."
+                << std::endl;
+    }
+    recordings.create(images);
+    /* Everything rewritten per frame shares the transient buffers. */
+    VkDeviceSize perFrame =
+        TransientBuffers::aligned(sizeof(Instance) *
+                                  VkDeviceSize(options.instances)) +
+        TransientBuffers::aligned(QuadBatcher::bytes(options.sprites));
+    if (perFrame > 0) {
+      transient.create(device.get(), allocator, perFrame, images);
+    }
+    if (options.sprites > 0) {
+      sprites.create(device.get(), allocator, uploader, options.sprites);
+    }
+    recorder.create(device.get(), device.graphicsFamily(), options.threads,
+                    images);
+    buildScene();
+    profiler.reserve(images);
+    imagesInFlight.assign(images, 0);
   }
 
   // Update the graphical elements.
   void loop() {
+    uint64_t frameCount = 0;
+    auto start = std::chrono::steady_clock::now();
     // Make sure the window runs throughout the program
-    while (!glfwWindowShouldClose(window)) {
-      glfwPollEvents();
+    while (options.headless || !glfwWindowShouldClose(window)) {
+      if (options.frameLimit > 0 && frameCount >= options.frameLimit) {
+        break;
+      }
+      if (!options.headless) {
+        glfwPollEvents();
+      }
       drawFrame();
+      frameCount++;
     }
     vkDeviceWaitIdle(device.get());
+
+    /* CPU side frame time, which is what frames in flight is meant to cut. */
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    if (frameCount > 0) {
+      std::cout << "[VkApp]: " << frameCount << " frames with "
+                << frames.size() << " in flight, "
+                << elapsed.count() / frameCount << " ms per frame, "
+                << recordings.recordings() << " command buffers recorded."
+                << std::endl;
+    }
+
+    /* Everything retired, so every slot can be read back. */
+    for (uint32_t slot = 0; slot < profiler.frameSlots(); slot++) {
+      profiler.collect(slot);
+    }
+    profiler.report(std::cout);
+    allocator.report(std::cout);
+    geometry.report(std::cout);
+    deletions.report(std::cout);
+    HostMemory::report(std::cout);
+    transient.report(std::cout);
+    queue.report(std::cout);
+    if (!options.tracePath.empty()) {
+      profiler.writeTrace(options.tracePath);
+    }
+  }
+
+  /**
+   * Fills the render queue from scratch, every recording is out of date.
+   * With indirect drawing the objects go to the GPU instead and the queue
+   * stays empty. Runs once, the object buffer is never rebuilt.
+   * */
+  void buildScene() {
+    queue.clear();
+    DrawPacket packet = geometry.packet(mesh, graphicsPipeline);
+    if (options.instances > 0) {
+      /* Every copy in one call, the instance stream tells them apart. */
+      DrawPacket instanced = packet;
+      instanced.pipeline = instancedPipeline;
+      instanced.instanceCount = options.instances;
+      queue.submit(instanced);
+    }
+    if (options.compact) {
+      /* Same buffers, only the vertex stream shrinks. */
+      packet = geometry.packet(packedMesh, packedPipeline);
+    }
+    if (useIndirect) {
+      /* Visibility is static input for now, nothing culls yet. */
+      std::vector<IndirectObject> objects(options.draws);
+      for (auto &object : objects) {
+        object.command = {packet.indexCount, 1, packet.firstIndex,
+                          packet.vertexOffset, 0};
+        object.visible = 1;
+      }
+      indirectDraws.create(device.get(), allocator, uploader,
+                           pipelineCache.get(), packet, objects,
+                           device.drawIndirectCount());
+      queue.sort();
+      recordings.invalidate();
+      return;
+    }
+    for (uint32_t i = 0; i < options.draws; i++) {
+      queue.submit(packet);
+    }
+    queue.sort();
+    recordings.invalidate();
   }
 
   void drawFrame() {
-    auto device = this->device.get();
-    vkWaitForFences(device, 1, &inFlightFence, VK_TRUE, UINT64_MAX);
-    vkResetFences(device, 1, &inFlightFence);
+    Frame &frame = frames[currentFrame];
+    /* Only wait for the frame that last used this slot, not the latest one. */
+    timeline.wait(frame.submitted);
+
+    deletions.collect(false);
 
     uint32_t imageIndex;
-    vkAcquireNextImageKHR(device, swapChain, UINT64_MAX,
-                          imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
+    if (!acquire(frame, imageIndex)) {
+      return;
+    }
 
-    vkResetCommandBuffer(commandBuffer, 0);
-    auto size = static_cast<uint32_t>(vertices.size());
+    /* The image may still be rendered by a different slot, and its command
+     * buffer may still run for an image of a retired swap chain. */
+    timeline.wait(imagesInFlight[imageIndex]);
+    timeline.wait(recordings.lastUse(imageIndex));
+
+    /* Nothing changed since this image was drawn last, replay it. Otherwise
+     * all of its old buffers are recycled at once and it is recorded anew. */
+    profiler.collect(imageIndex);
+    Scene scene{queue};
+    transient.begin(imageIndex);
+    if (options.instances > 0) {
+      Transient instances = updateInstances();
+      scene.instances = instances.buffer;
+      scene.instanceOffset = instances.offset;
+    }
+    if (useIndirect) {
+      scene.indirect = &indirectDraws;
+    }
+    if (options.sprites > 0) {
+      updateSprites(imageIndex);
+      scene.sprites = &sprites;
+    }
+    if (recordings.stale(imageIndex)) {
+      VkCommandBuffer commandBuffer = recorder.begin(imageIndex);
+      auto &secondaries = recorder.record(imageIndex, renderPass,
+                                          swapChainFramebuffers[imageIndex],
+                                          swapChainExtent, scene);
+      Commands::record(commandBuffer, imageIndex, renderPass,
+                       swapChainFramebuffers, swapChainExtent, scene,
+                       secondaries, profiler, imageIndex);
+      recordings.recorded(imageIndex, commandBuffer);
+    }
+    VkCommandBuffer commandBuffer = recordings.get(imageIndex);
 
-    Commands::record(commandBuffer, imageIndex, renderPass, vertexBuffer, indexBuffer,
-                     swapChainFramebuffers, swapChainExtent, graphicsPipeline,
-                     size, static_cast<uint32_t>(indices.size()));
+    /* Anything queued since the last frame has to be on the queue first. */
+    uploader.flush();
 
     /* Submit info */
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    Submit submit;
+    if (!options.headless) {
+      submit.wait(frame.imageAvailable,
+                  VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+      submit.signal(frame.renderFinished);
+    }
+    submit.commands(commandBuffer);
+    frame.submitted = timeline.submit(this->device.gQueue(), submit);
+    imagesInFlight[imageIndex] = frame.submitted;
+    recordings.lastUse(imageIndex) = frame.submitted;
+    profiler.submitted(imageIndex);
+    framesDrawn++;
+
+    if (!options.headless) {
+      present(frame, imageIndex);
+    }
+
+    currentFrame = (currentFrame + 1) % static_cast<uint32_t>(frames.size());
+  }
 
-    VkSemaphore waitSemaphores[] = {imageAvailableSemaphore};
-    VkPipelineStageFlags waitStages[] = {
-        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-    submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = waitSemaphores;
-    submitInfo.pWaitDstStageMask = waitStages;
+  /* Lays the instances out on a grid and lets them pulse, in this frame's
+   * transient memory. */
+  Transient updateInstances() {
+    uint32_t count = options.instances;
+    Transient space = transient.allocate(sizeof(Instance) * count);
+    auto instances = static_cast<Instance *>(space.mapped);
+    auto side = static_cast<uint32_t>(std::ceil(std::sqrt(double(count))));
+    float cell = 2.0f / static_cast<float>(side);
+    float phase = static_cast<float>(framesDrawn) * 0.05f;
+    for (uint32_t i = 0; i < count; i++) {
+      uint32_t x = i % side;
+      uint32_t y = i / side;
+      float scale = cell * (0.75f + 0.25f * std::sin(phase + 0.01f * i));
+      instances[i].offset = {-1.0f + cell * (x + 0.5f),
+                             -1.0f + cell * (y + 0.5f)};
+      instances[i].scale = {scale, scale};
+      instances[i].color = {float(x) / side, float(y) / side, 1.0f};
+    }
+    return space;
+  }
 
-    /* Specify command buffers */
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffer;
+  /* A field of small quads drifting to the right. Only when the batches come
+   * out different from the image's last frame is its recording redone. */
+  void updateSprites(uint32_t imageIndex) {
+    sprites.begin(transient, imageIndex);
+    uint32_t count = options.sprites;
+    auto side = static_cast<uint32_t>(std::ceil(std::sqrt(double(count))));
+    float cell = 2.0f / static_cast<float>(side);
+    float shift = static_cast<float>(framesDrawn % 120) / 120.0f * cell;
+    for (uint32_t i = 0; i < count; i++) {
+      uint32_t x = i % side;
+      uint32_t y = i / side;
+      sprites.add(graphicsPipeline,
+                  {-1.0f + cell * (x + 0.5f) + shift, -1.0f + cell * (y + 0.5f)},
+                  {cell * 0.8f, cell * 0.8f},
+                  {1.0f, float(x) / side, float(y) / side});
+    }
+    if (sprites.changed()) {
+      recordings.invalidate(imageIndex);
+    }
+  }
 
-    VkSemaphore signalSemaphores[] = {renderFinishedSemaphore};
-    submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = signalSemaphores;
+  /* Picks the image to render into. False means skip this frame. */
+  bool acquire(Frame &frame, uint32_t &imageIndex) {
+    if (options.headless) {
+      imageIndex = currentFrame;
+      return true;
+    }
 
-    if (vkQueueSubmit(this->device.gQueue(), 1, &submitInfo, inFlightFence) !=
-        VK_SUCCESS) {
-      throw std::runtime_error(
-          "[VkApp]: You half baked commands doesn't make me tick. Fix it.");
+    VkResult result = vkAcquireNextImageKHR(device.get(), swapChain, UINT64_MAX,
+                                            frame.imageAvailable,
+                                            VK_NULL_HANDLE, &imageIndex);
+    if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+      /* Nothing was acquired, so the slot can be reused right away. */
+      recreateSwapChain();
+      return false;
+    } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+      throw std::runtime_error("[VkApp]: No image for me to draw on.");
     }
+    return true;
+  }
 
+  void present(Frame &frame, uint32_t imageIndex) {
     /* Drawing */
     VkPresentInfoKHR presentInfo{};
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
     presentInfo.waitSemaphoreCount = 1;
-    presentInfo.pWaitSemaphores = signalSemaphores;
+    presentInfo.pWaitSemaphores = &frame.renderFinished;
 
     VkSwapchainKHR swapChains[] = {swapChain};
     presentInfo.swapchainCount = 1;
     presentInfo.pSwapchains = swapChains;
     presentInfo.pImageIndices = &imageIndex;
 
-    vkQueuePresentKHR(this->device.queue(), &presentInfo);
+    VkResult result = vkQueuePresentKHR(device.queue(), &presentInfo);
+    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR ||
+        framebufferResized) {
+      recreateSwapChain();
+    } else if (result != VK_SUCCESS) {
+      throw std::runtime_error("[VkApp]: Drew it, but couldn't show it.");
+    }
   }
 
   // Free the allocated resources
   void clean() {
-    vkDestroySemaphore(device.get(), imageAvailableSemaphore, nullptr);
-    vkDestroySemaphore(device.get(), renderFinishedSemaphore, nullptr);
-    vkDestroyFence(device.get(), inFlightFence, nullptr);
-
-    Commands::clean(device.get(), commandPool);
-    FrameBuffers::clean(device.get(), swapChainFramebuffers);
+    Frames::clean(device.get(), frames);
+    recordings.clean();
+    recorder.clean();
+    transient.clean();
+    if (options.sprites > 0) {
+      sprites.clean();
+    }
+    uploader.clean();
+    profiler.clean();
+    timeline.clean();
+
+    deletions.collect(true);
+    cleanSwapChain();
+    if (useIndirect) {
+      indirectDraws.clean(allocator);
+    }
     Pipeline::clean(device.get(), pipelineLayout, graphicsPipeline);
-    RenderPass::clean(device.get(), renderPass);
-    for (auto imageView : swapChainImageViews) {
-      vkDestroyImageView(device.get(), imageView, nullptr);
+    if (options.instances > 0) {
+      Pipeline::clean(device.get(), instancedLayout, instancedPipeline);
     }
-    vkDestroySwapchainKHR(device.get(), swapChain, nullptr);
-    Buffers::clean(device.get(), indexBuffer);
-    Allocation::free(device.get(), indexBufferMemory);
-
-    Buffers::clean(device.get(), vertexBuffer);
-    Allocation::free(device.get(), vertexBufferMemory);
+    if (options.compact) {
+      Pipeline::clean(device.get(), packedLayout, packedPipeline);
+    }
+    pipelineCache.clean();
+    RenderPass::clean(device.get(), renderPass);
+    geometry.clean();
+    allocator.clean();
 
     if (enableValidationLayers) {
-      Messages::destroyDebugMsgExt(instance, debugMessenger, nullptr);
+      Messages::destroyDebugMsgExt(instance, debugMessenger,
+                                   HostMemory::callbacks());
     }
     device.clean();
-    vkDestroySurfaceKHR(instance, surface, nullptr);
-    vkDestroyInstance(instance, nullptr);
-    glfwDestroyWindow(window);
-    glfwTerminate();
+    if (!options.headless) {
+      vkDestroySurfaceKHR(instance, surface, HostMemory::callbacks());
+    }
+    vkDestroyInstance(instance, HostMemory::callbacks());
+    if (!options.headless) {
+      glfwDestroyWindow(window);
+      glfwTerminate();
+    }
+    HostMemory::clean();
   }
 
   // Handle the vulkan instance creation
@@ -193,7 +491,7 @@ private:
     createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
     createInfo.pApplicationInfo = &appInfo;
     VkDebugUtilsMessengerCreateInfoEXT dbgCreateInfo{};
-    auto extensions = Extensions::get();
+    auto extensions = Extensions::get(options.headless);
     createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
     createInfo.ppEnabledExtensionNames = extensions.data();
 
@@ -211,14 +509,71 @@ private:
       createInfo.pNext = nullptr;
     }
 
-    if (vkCreateInstance(&createInfo, nullptr, &instance) != VK_SUCCESS) {
+    if (vkCreateInstance(&createInfo, HostMemory::callbacks(), &instance) !=
+        VK_SUCCESS) {
       throw std::runtime_error("[VkApp]: Hey, I can't create new instance!");
     }
   }
 
+  /**
+   * Builds a new swap chain next to the current one and rebuilds only what
+   * depends on its extent. The old chain is handed to the driver as
+   * oldSwapchain and destroyed later, once the GPU has caught up, so a resize
+   * never has to wait for the device to go idle.
+   * */
+  void recreateSwapChain() {
+    int width = 0, height = 0;
+    glfwGetFramebufferSize(window, &width, &height);
+    /* Minimized, there is nothing to present to. */
+    while (width == 0 || height == 0) {
+      glfwGetFramebufferSize(window, &width, &height);
+      glfwWaitEvents();
+    }
+    /* Whatever path got us here, this rebuild covers the pending resize. */
+    framebufferResized = false;
+
+    /* Give the presentation engine a few more frames to let go of it. */
+    uint64_t retireValue = timeline.last() + frames.size();
+    VkSwapchainKHR oldSwapChain = swapChain;
+    deletions.framebuffers(retireValue, swapChainFramebuffers);
+    deletions.imageViews(retireValue, swapChainImageViews);
+    deletions.swapChain(retireValue, oldSwapChain);
+
+    VkFormat previousFormat = swapChainImageFormat;
+    SwapChain::create(window, physicalDevice.get(), surface, device.get(),
+                      &swapChain, swapChainImages, swapChainImageFormat,
+                      swapChainExtent, oldSwapChain);
+    if (swapChainImageFormat != previousFormat) {
+      throw std::runtime_error("[VkApp]: The surface changed its format on "
+                               "me, my render pass can't keep up.");
+    }
+    createImageViews();
+    FrameBuffers::create(device.get(), renderPass, swapChainFramebuffers,
+                         swapChainImageViews, swapChainExtent);
+    auto images = static_cast<uint32_t>(swapChainImages.size());
+    profiler.reserve(images);
+    recordings.resize(images);
+    transient.resize(images);
+    recorder.resize(images);
+    imagesInFlight.assign(images, 0);
+  }
+
+  void cleanSwapChain() {
+    FrameBuffers::clean(device.get(), swapChainFramebuffers);
+    for (auto imageView : swapChainImageViews) {
+      vkDestroyImageView(device.get(), imageView, HostMemory::callbacks());
+    }
+    if (options.headless) {
+      Offscreen::clean(device.get(), allocator, swapChainImages,
+                       offscreenMemory);
+    } else {
+      vkDestroySwapchainKHR(device.get(), swapChain, HostMemory::callbacks());
+    }
+  }
+
   void createSurface() {
-    if (glfwCreateWindowSurface(instance, window, nullptr, &surface) !=
-        VK_SUCCESS) {
+    if (glfwCreateWindowSurface(instance, window, HostMemory::callbacks(),
+                                &surface) != VK_SUCCESS) {
       throw std::runtime_error("[VkApp]: Surface denied...., must need one.!");
     }
   }
@@ -243,7 +598,7 @@ private:
       createInfo.subresourceRange.levelCount = 1;
       createInfo.subresourceRange.baseArrayLayer = 0;
       createInfo.subresourceRange.layerCount = 1;
-      if (vkCreateImageView(device.get(), &createInfo, nullptr,
+      if (vkCreateImageView(device.get(), &createInfo, HostMemory::callbacks(),
                             &swapChainImageViews[i]) != VK_SUCCESS) {
         throw std::runtime_error(
             "[VkApp]: You don't have views, you can't see!");
@@ -257,65 +612,68 @@ private:
     VkDebugUtilsMessengerCreateInfoEXT createInfo;
     Messages::populate(createInfo);
 
-    if (Messages::createDebugMsgExt(instance, &createInfo, nullptr,
+    if (Messages::createDebugMsgExt(instance, &createInfo,
+                                    HostMemory::callbacks(),
                                     &debugMessenger) != VK_SUCCESS) {
       throw std::runtime_error(
           "[VkApp]: Well, you will not get debugger. Sad....");
     }
   }
 
-  void createSyncObjects() {
-    VkSemaphoreCreateInfo semaphoreInfo{};
-    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-    VkFenceCreateInfo fenceInfo{};
-    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-    if (vkCreateSemaphore(device.get(), &semaphoreInfo, nullptr,
-                          &imageAvailableSemaphore) != VK_SUCCESS ||
-        vkCreateSemaphore(device.get(), &semaphoreInfo, nullptr,
-                          &renderFinishedSemaphore) != VK_SUCCESS ||
-        vkCreateFence(device.get(), &fenceInfo, nullptr, &inFlightFence) !=
-            VK_SUCCESS) {
-      throw std::runtime_error("[VkApp]: I will mess your pixels. There is no "
-                               "way I want to synchronize. It slows me.!");
-    }
-  }
+  Options options;
 
   // Window context
-  GLFWwindow *window;
+  GLFWwindow *window = nullptr;
   VkInstance instance;
-  VkSurfaceKHR surface;
+  VkSurfaceKHR surface = VK_NULL_HANDLE;
   VkDebugUtilsMessengerEXT debugMessenger;
   PhysicalDevice physicalDevice;
   LogicalDevice device;
-  VkSwapchainKHR swapChain;
+  VkSwapchainKHR swapChain = VK_NULL_HANDLE;
   VkRenderPass renderPass;
   VkPipeline graphicsPipeline;
-  VkCommandPool commandPool;
-  VkCommandBuffer commandBuffer;
-  VkSemaphore imageAvailableSemaphore;
-  VkSemaphore renderFinishedSemaphore;
-  VkFence inFlightFence;
-  VkBuffer vertexBuffer;
-  VkDeviceMemory vertexBufferMemory;
-  VkBuffer indexBuffer;
-  VkDeviceMemory indexBufferMemory;
-
-  // Load object
-  const std::vector<Vertex> vertices = Shape::create();
-  const std::vector<std::uint16_t> indices = Shape::indices();
-
-  // Map
-  void *data;
-  void *index_data;
-
-  // Swap chain related.
+  PipelineCache pipelineCache;
+
+  // Frames in flight
+  Timeline timeline;
+  Profiler profiler;
+  Uploader uploader;
+  std::vector<Frame> frames;
+  Recordings recordings;
+  Recorder recorder;
+  RenderQueue queue;
+  IndirectDraws indirectDraws;
+  bool useIndirect = false;
+  std::vector<uint64_t> imagesInFlight;
+  uint32_t currentFrame = 0;
+  bool framebufferResized = false;
+  Allocator allocator;
+  GeometryPool geometry;
+  MeshHandle mesh;
+  MeshHandle packedMesh;
+
+  // Load object, reordered by the MeshOptimizer before upload
+  std::vector<Vertex> vertices = Shape::create();
+  std::vector<std::uint16_t> indices = Shape::indices();
+
+  // Swap chain related. Headless runs keep their offscreen targets here.
   std::vector<VkImage> swapChainImages;
+  std::vector<Memory> offscreenMemory;
   std::vector<VkImageView> swapChainImageViews;
   std::vector<VkFramebuffer> swapChainFramebuffers;
   VkFormat swapChainImageFormat;
   VkExtent2D swapChainExtent;
   VkPipelineLayout pipelineLayout;
+  VkPipeline instancedPipeline = VK_NULL_HANDLE;
+  VkPipelineLayout instancedLayout = VK_NULL_HANDLE;
+  TransientBuffers transient;
+  QuadBatcher sprites;
+  VkPipeline packedPipeline = VK_NULL_HANDLE;
+  VkPipelineLayout packedLayout = VK_NULL_HANDLE;
+  uint64_t framesDrawn = 0;
+
+  // Whatever was replaced at runtime, waiting for the GPU to let go.
+  DeletionQueue deletions;
 };
 
 } // namespace App
@@ -0,0 +1,164 @@
+#ifndef BATCHER_H_
+#define BATCHER_H_
+
+#include "allocator.hpp"
+#include "buffers.hpp"
+#include "transient.hpp"
+#include "uploads.hpp"
+#include "vertex.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+/**
+ * Collects 2D quads for one frame and draws them in as few calls as it can.
+ * Quads are written straight into the frame's transient memory, in the order
+ * they were added, `capacity` quads to a chunk. A full chunk is followed by
+ * another one, so a frame takes any number of quads; `capacity` only sizes
+ * the pieces. A new batch starts when the pipeline or the chunk changes, so
+ * painter's order is kept.
+ *
+ * All quads share one static index buffer of the 0 1 2 2 3 0 pattern. It is
+ * 16 bit and covers QUADS_PER_DRAW quads, larger batches are split into
+ * draws that rebase it with vertexOffset.
+ * */
+class QuadBatcher {
+public:
+  /* Four vertices a quad, the last index still fits in 16 bits. */
+  static constexpr uint32_t QUADS_PER_DRAW = 65536 / 4;
+
+  /* Transient memory a chunk of `capacity` quads takes. */
+  static constexpr VkDeviceSize bytes(uint32_t capacity) {
+    return sizeof(Vertex) * 4 * static_cast<VkDeviceSize>(capacity);
+  }
+
+  void create(const VkDevice &device, Allocator &allocator,
+              Uploader &uploader, uint32_t capacity) {
+    if (capacity == 0) {
+      throw std::runtime_error("[VkQuadBatcher]: Chunks of no quads, really?");
+    }
+    this->device = device;
+    this->allocator = &allocator;
+    this->capacity = capacity;
+
+    std::vector<uint16_t> indices(QUADS_PER_DRAW * 6);
+    for (uint32_t quad = 0; quad < QUADS_PER_DRAW; quad++) {
+      auto base = static_cast<uint16_t>(quad * 4);
+      uint16_t pattern[] = {0, 1, 2, 2, 3, 0};
+      for (uint32_t i = 0; i < 6; i++) {
+        indices[quad * 6 + i] = static_cast<uint16_t>(base + pattern[i]);
+      }
+    }
+    IndexBuffers::create(device, allocator, indexBuffer, indexMemory, indices,
+                         uploader);
+  }
+
+  /* Starts a frame for `image`, its vertices come out of `transient`, which
+   * has to have begun the same image. */
+  void begin(TransientBuffers &transient, uint32_t image) {
+    /* The last frame's image got recorded or replayed with what it wrote. */
+    drawn.resize(std::max<size_t>(drawn.size(), std::max(current, image) + 1));
+    drawn[current].swap(batches);
+    current = image;
+    this->transient = &transient;
+    vertices = nullptr;
+    chunkQuads = 0;
+    quads = 0;
+    batches.clear();
+  }
+
+  /* An axis aligned quad around `center`. */
+  void add(const VkPipeline &pipeline, glm::vec2 center, glm::vec2 size,
+           glm::vec3 color) {
+    bool chunked = vertices == nullptr || chunkQuads == capacity;
+    if (chunked) {
+      space = transient->allocate(bytes(capacity));
+      vertices = static_cast<Vertex *>(space.mapped);
+      chunkQuads = 0;
+    }
+    if (chunked || batches.back().pipeline != pipeline) {
+      batches.push_back({pipeline, space.buffer, space.offset, chunkQuads, 0});
+    }
+    glm::vec2 half = size * 0.5f;
+    Vertex *quad = vertices + chunkQuads * 4;
+    quad[0] = {{center.x - half.x, center.y - half.y}, color};
+    quad[1] = {{center.x + half.x, center.y - half.y}, color};
+    quad[2] = {{center.x + half.x, center.y + half.y}, color};
+    quad[3] = {{center.x - half.x, center.y + half.y}, color};
+    batches.back().quads++;
+    chunkQuads++;
+    quads++;
+  }
+
+  /* Whether the batches differ from the ones the image drew last time,
+   * meaning its recording would draw the wrong thing. Every image has its
+   * own transient buffer, so only the same image is worth comparing with. */
+  bool changed() const { return batches != drawn[current]; }
+
+  /* Draws the frame's batches. Viewport and scissor must be set. */
+  void record(const VkCommandBuffer &commandBuffer) const {
+    if (batches.empty()) {
+      return;
+    }
+    vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT16);
+    VkPipeline bound = VK_NULL_HANDLE;
+    const Batch *chunk = nullptr;
+    for (const auto &batch : batches) {
+      if (chunk == nullptr || batch.buffer != chunk->buffer ||
+          batch.offset != chunk->offset) {
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, &batch.buffer,
+                               &batch.offset);
+        chunk = &batch;
+      }
+      if (batch.pipeline != bound) {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                          batch.pipeline);
+        bound = batch.pipeline;
+      }
+      for (uint32_t done = 0; done < batch.quads; done += QUADS_PER_DRAW) {
+        uint32_t count = std::min(QUADS_PER_DRAW, batch.quads - done);
+        vkCmdDrawIndexed(commandBuffer, count * 6, 1, 0,
+                         static_cast<int32_t>((batch.first + done) * 4), 0);
+      }
+    }
+  }
+
+  uint32_t size() const { return quads; }
+
+  void clean() {
+    Buffers::clean(device, indexBuffer);
+    allocator->free(indexMemory);
+  }
+
+private:
+  struct Batch {
+    VkPipeline pipeline;
+    /* The chunk, first is counted from its start. */
+    VkBuffer buffer;
+    VkDeviceSize offset;
+    uint32_t first;
+    uint32_t quads;
+
+    bool operator==(const Batch &other) const = default;
+  };
+
+  VkDevice device = VK_NULL_HANDLE;
+  Allocator *allocator = nullptr;
+  uint32_t capacity = 0;
+  VkBuffer indexBuffer = VK_NULL_HANDLE;
+  Memory indexMemory;
+
+  TransientBuffers *transient = nullptr;
+  Transient space;
+  Vertex *vertices = nullptr;
+  uint32_t chunkQuads = 0;
+  uint32_t quads = 0;
+  std::vector<Batch> batches;
+  /* Per image, the batches its recording was last made or replayed with. */
+  std::vector<std::vector<Batch>> drawn;
+  uint32_t current = 0;
+};
+
+#endif // BATCHER_H_
@@ -1,6 +1,8 @@
 #ifndef BUFFERS_H
 #define BUFFERS_H
-#include "allocation.hpp"
+#include "allocator.hpp"
+#include "hostmemory.hpp"
+#include "uploads.hpp"
 #include "vertex.hpp"
 #include <cstdint>
 #include <cstring>
@@ -26,7 +28,7 @@ struct FrameBuffers {
       framebufferInfo.height = swapChainExtent.height;
       framebufferInfo.layers = 1;
 
-      if (vkCreateFramebuffer(device, &framebufferInfo, nullptr,
+      if (vkCreateFramebuffer(device, &framebufferInfo, HostMemory::callbacks(),
                               &swapChainFramebuffers[i]) != VK_SUCCESS) {
         throw std::runtime_error("[VkFrameBuffer]: I want to display images. "
                                  "Please give me frame buffers.");
@@ -37,7 +39,7 @@ struct FrameBuffers {
   static void clean(const VkDevice &device,
                     const std::vector<VkFramebuffer> &swapChainFramebuffers) {
     for (auto framebuffer : swapChainFramebuffers) {
-      vkDestroyFramebuffer(device, framebuffer, nullptr);
+      vkDestroyFramebuffer(device, framebuffer, HostMemory::callbacks());
     }
   }
 };
@@ -52,8 +54,8 @@ struct Buffers {
     bufferInfo.usage = usage;
     bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-    if (vkCreateBuffer(device, &bufferInfo, nullptr, &vertexBuffer) !=
-        VK_SUCCESS) {
+    if (vkCreateBuffer(device, &bufferInfo, HostMemory::callbacks(),
+                       &vertexBuffer) != VK_SUCCESS) {
       throw std::runtime_error("[VkVertexBuffer]: Lol, I don't have vertices. "
                                "You want me to display a blank screen?!");
     }
@@ -62,121 +64,73 @@ struct Buffers {
   }
 
   static void clean(const VkDevice &device, const VkBuffer &buffer) {
-    vkDestroyBuffer(device, buffer, nullptr);
+    vkDestroyBuffer(device, buffer, HostMemory::callbacks());
+  }
+
+  /* Device local memory, host visible too where the CPU can write all of
+   * it. Then buffers are filled in place and the uploader stays idle. */
+  static MemoryRequest deviceLocal(const Allocator &allocator) {
+    if (!allocator.directWrites()) {
+      return VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    }
+    return {VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                VK_MEMORY_PROPERTY_HOST_COHERENT_BIT};
+  }
+
+  /* Host memory the CPU rewrites every frame, device local if possible so
+   * the GPU doesn't read it over the bus. */
+  static constexpr MemoryRequest STREAMING{
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT};
+
+  /* Writes straight into mapped memory, or queues an upload if it isn't. */
+  static Ticket fill(const Allocator &allocator, Uploader &uploader,
+                     const VkBuffer &buffer, const Memory &memory,
+                     VkDeviceSize offset, const void *data, VkDeviceSize size) {
+    if (allocator.writable(memory)) {
+      memcpy(static_cast<char *>(memory.mapped) + offset, data, (size_t)size);
+      return {};
+    }
+    return uploader.upload(buffer, offset, data, size);
   }
 };
 
 struct VertexBuffers {
-  static void create(const VkDevice &device,
-                     const VkPhysicalDevice &physicalDevice,
-                     VkBuffer &vertexBuffer, VkDeviceMemory &vertexBufferMemory,
-                     const std::vector<Vertex> &vertices, void *data,
-                     const VkCommandPool &commandPool,
-                     const VkQueue &graphicsQueue) {
-
-    // Vertex buffer is here.
+  /* Creates the buffer and queues its contents, nothing is waited on. */
+  template <typename V>
+  static Ticket create(const VkDevice &device, Allocator &allocator,
+                       VkBuffer &vertexBuffer, Memory &vertexBufferMemory,
+                       const std::vector<V> &vertices, Uploader &uploader) {
     auto buffer_size = sizeof(vertices[0]) * vertices.size();
 
-    // Staging buffer.
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    auto stagingBufferInfo = Buffers::create(device, stagingBuffer, buffer_size,
-                                             VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
-    Allocation::allocate(device, physicalDevice, stagingBuffer,
-                         stagingBufferMemory,
-                         (VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT));
-
-    vkMapMemory(device, stagingBufferMemory, 0, buffer_size, 0, &data);
-    mempcpy(data, vertices.data(), (size_t)buffer_size);
-    vkUnmapMemory(device, stagingBufferMemory);
-
-
-    auto bufferInfo = Buffers::create(device, vertexBuffer, buffer_size,
-                                      VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
-                                          VK_BUFFER_USAGE_TRANSFER_DST_BIT);
-    Allocation::allocate(device, physicalDevice, vertexBuffer,
-                         vertexBufferMemory,
-                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-    copy(stagingBuffer, vertexBuffer, buffer_size, commandPool, device, graphicsQueue);
-
-    // Then destory the staging buffers.
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingBufferMemory, nullptr);
-  }
+    Buffers::create(device, vertexBuffer, buffer_size,
+                    VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+                        VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    vertexBufferMemory =
+        allocator.allocate(vertexBuffer, Buffers::deviceLocal(allocator));
 
-  static void copy(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size,
-            const VkCommandPool &commandPool, const VkDevice &device,
-            const VkQueue &graphicsQueue) {
-    VkCommandBufferAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandPool = commandPool;
-    allocInfo.commandBufferCount = 1;
-
-    VkCommandBuffer commandBuffer;
-    vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
-
-    VkCommandBufferBeginInfo beginInfo{};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-    vkBeginCommandBuffer(commandBuffer, &beginInfo);
-    VkBufferCopy copyRegion{};
-    copyRegion.size = size;
-    vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
-    vkEndCommandBuffer(commandBuffer);
-
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffer;
-
-    vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-    vkQueueWaitIdle(graphicsQueue);
-
-    vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+    return Buffers::fill(allocator, uploader, vertexBuffer, vertexBufferMemory,
+                         0, vertices.data(), buffer_size);
   }
 };
 
 struct IndexBuffers {
-  static void create(const VkDevice &device,
-                     const VkPhysicalDevice &physicalDevice,
-                     VkBuffer &indexBuffer, VkDeviceMemory &indexBufferMemory,
-                     const std::vector<std::uint16_t> &indices, void *data,
-                     const VkCommandPool &commandPool,
-                     const VkQueue &graphicsQueue) {
-
+  static Ticket create(const VkDevice &device, Allocator &allocator,
+                       VkBuffer &indexBuffer, Memory &indexBufferMemory,
+                       const std::vector<std::uint16_t> &indices,
+                       Uploader &uploader) {
     VkDeviceSize buffer_size = sizeof(indices[0]) * indices.size();
 
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    auto stagingBufferInfo = Buffers::create(device, stagingBuffer, buffer_size,
-                                             VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
-    Allocation::allocate(device, physicalDevice, stagingBuffer,
-                         stagingBufferMemory,
-                         (VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT));
-
-    vkMapMemory(device, stagingBufferMemory, 0, buffer_size, 0, &data);
-    mempcpy(data, indices.data(), (size_t)buffer_size);
-    vkUnmapMemory(device, stagingBufferMemory);
-
-
-    auto bufferInfo = Buffers::create(device, indexBuffer, buffer_size,
-                                      VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
-                                          VK_BUFFER_USAGE_TRANSFER_DST_BIT);
-    Allocation::allocate(device, physicalDevice, indexBuffer,
-                         indexBufferMemory,
-                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-    VertexBuffers::copy(stagingBuffer, indexBuffer, buffer_size, commandPool, device, graphicsQueue);
-
-    // Then destory the staging buffers.
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingBufferMemory, nullptr);
+    Buffers::create(device, indexBuffer, buffer_size,
+                    VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+                        VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    indexBufferMemory =
+        allocator.allocate(indexBuffer, Buffers::deviceLocal(allocator));
 
+    return Buffers::fill(allocator, uploader, indexBuffer, indexBufferMemory,
+                         0, indices.data(), buffer_size);
   }
 };
 
@@ -0,0 +1,108 @@
+#ifndef COMMANDPOOLS_H_
+#define COMMANDPOOLS_H_
+
+#include "hostmemory.hpp"
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+/**
+ * Transient command pools, one per slot and thread. Buffers are handed out
+ * front to back and never freed or reset one by one; once everything a slot
+ * submitted has retired, reset() recycles the whole slot with a single
+ * vkResetCommandPool per thread and the next round starts from the front.
+ * */
+class CommandPools {
+public:
+  /* Buffers are allocated from the driver this many at a time. */
+  static constexpr uint32_t GROW = 4;
+
+  void create(const VkDevice &device, uint32_t queueFamily, uint32_t threads) {
+    this->device = device;
+    this->queueFamily = queueFamily;
+    this->threads = threads;
+  }
+
+  void resize(uint32_t slots) {
+    while (this->slots.size() < slots) {
+      std::vector<Pool> pools(threads);
+      for (auto &pool : pools) {
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        poolInfo.queueFamilyIndex = queueFamily;
+        if (vkCreateCommandPool(device, &poolInfo, HostMemory::callbacks(),
+                                &pool.pool) != VK_SUCCESS) {
+          throw std::runtime_error("[VkCommandPools]: Uh... I don't have a "
+                                   "pool.!");
+        }
+      }
+      this->slots.push_back(std::move(pools));
+    }
+  }
+
+  /* Everything `slot` handed out is free again. Its work must have retired. */
+  void reset(uint32_t slot) {
+    for (auto &pool : slots[slot]) {
+      vkResetCommandPool(device, pool.pool, 0);
+      pool.primaries.used = 0;
+      pool.secondaries.used = 0;
+    }
+  }
+
+  /* The next unused buffer of `thread`'s pool in `slot`. Only `thread` may
+   * call this for its pool. */
+  VkCommandBuffer allocate(uint32_t slot, uint32_t thread,
+                           VkCommandBufferLevel level) {
+    Pool &pool = slots[slot][thread];
+    Buffers &buffers = level == VK_COMMAND_BUFFER_LEVEL_PRIMARY
+                           ? pool.primaries
+                           : pool.secondaries;
+    if (buffers.used == buffers.handles.size()) {
+      VkCommandBufferAllocateInfo allocInfo{};
+      allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+      allocInfo.commandPool = pool.pool;
+      allocInfo.level = level;
+      allocInfo.commandBufferCount = GROW;
+
+      buffers.handles.resize(buffers.handles.size() + GROW);
+      if (vkAllocateCommandBuffers(device, &allocInfo,
+                                   buffers.handles.data() + buffers.used) !=
+          VK_SUCCESS) {
+        throw std::runtime_error("[VkCommandPools]: I have pools, but I need "
+                                 "buffers. Please fix the buffers.");
+      }
+    }
+    return buffers.handles[buffers.used++];
+  }
+
+  /* Buffers go away together with their pool. */
+  void clean() {
+    for (auto &pools : slots) {
+      for (auto &pool : pools) {
+        vkDestroyCommandPool(device, pool.pool, HostMemory::callbacks());
+      }
+    }
+    slots.clear();
+  }
+
+private:
+  struct Buffers {
+    std::vector<VkCommandBuffer> handles;
+    size_t used = 0;
+  };
+
+  struct Pool {
+    VkCommandPool pool = VK_NULL_HANDLE;
+    Buffers primaries;
+    Buffers secondaries;
+  };
+
+  VkDevice device = VK_NULL_HANDLE;
+  uint32_t queueFamily = 0;
+  uint32_t threads = 1;
+  std::vector<std::vector<Pool>> slots;
+};
+
+#endif // COMMANDPOOLS_H_
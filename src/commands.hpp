@@ -1,58 +1,44 @@
 #ifndef COMMANDS_H_
 #define COMMANDS_H_
 
-#include "swapchain.hpp"
+#include "batcher.hpp"
+#include "indirect.hpp"
+#include "profiler.hpp"
+#include "renderqueue.hpp"
+#include "vertex.hpp"
+#include <cstddef>
 #include <cstdint>
+#include <stdexcept>
+#include <vector>
 #include <vulkan/vulkan_core.h>
 
-struct Commands {
-  static void createPool(const VkPhysicalDevice &physicalDevice,
-                         const VkSurfaceKHR &surface, const VkDevice &device,
-                         VkCommandPool &commandPool) {
-    QueueFamilyIndices queueFamilyIndices =
-        QueueFamilyIndices::find(physicalDevice, surface);
-
-    VkCommandPoolCreateInfo poolInfo{};
-    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-    poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
-
-    if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) !=
-        VK_SUCCESS) {
-      throw std::runtime_error("[VkCommands]: Uh... I don't have a pool.!");
-    }
-  }
-
-  static void createBuffers(const VkDevice &device,
-                            const VkCommandPool &commandPool,
-                            VkCommandBuffer &commandBuffer) {
-    VkCommandBufferAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.commandPool = commandPool;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandBufferCount = 1;
-
-    if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) !=
-        VK_SUCCESS) {
-      throw std::runtime_error("[VkCommands]: I have pools, but I need "
-                               "buffers. Please fix the buffers.");
-    }
-  }
-
-  static void clean(const VkDevice &device, const VkCommandPool &commandPool) {
-    vkDestroyCommandPool(device, commandPool, nullptr);
-  }
+/**
+ * Everything a frame draws. The sorted queue comes first; whatever records
+ * the end of the queue also records the indirect draws and the sprites, so
+ * they land behind it in order.
+ * */
+struct Scene {
+  const RenderQueue &queue;
+  /* Feeds the per instance binding of every draw, when set. */
+  VkBuffer instances = VK_NULL_HANDLE;
+  VkDeviceSize instanceOffset = 0;
+  const IndirectDraws *indirect = nullptr;
+  const QuadBatcher *sprites = nullptr;
+};
 
+struct Commands {
+  /**
+   * Records one frame into `commandBuffer`. The scene's draws either go in
+   * inline or, when `secondaries` were recorded for this image, the render
+   * pass just executes those. Indirect compaction runs ahead of the render
+   * pass either way.
+   * */
   static void record(const VkCommandBuffer &commandBuffer, uint32_t imageIndex,
                      const VkRenderPass &renderPass,
-                     const VkBuffer &vertexBuffer,
-                     const VkBuffer &indexBuffer,
                      const std::vector<VkFramebuffer> &swapChainFramebuffers,
-                     const VkExtent2D &swapChainExtent,
-                     const VkPipeline &graphicsPipeline,
-                     uint32_t size,
-                     uint32_t indices_size
-    ) {
+                     const VkExtent2D &swapChainExtent, const Scene &scene,
+                     const std::vector<VkCommandBuffer> &secondaries,
+                     Profiler &profiler, uint32_t slot) {
 
     VkCommandBufferBeginInfo beginInfo{};
     beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -62,35 +48,114 @@ struct Commands {
     if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
       throw std::runtime_error("[VkCommands]: Recorder is stuck. Fix it.!");
     }
+    profiler.begin(commandBuffer, slot);
+
+    {
+      Profiler::Scope frameScope(profiler, commandBuffer, "frame");
+      if (scene.indirect) {
+        Profiler::Scope cullScope(profiler, commandBuffer, "cull");
+        scene.indirect->compact(commandBuffer);
+      }
+
+      VkRenderPassBeginInfo renderPassInfo{};
+      renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+      renderPassInfo.renderPass = renderPass;
+      renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
+      renderPassInfo.renderArea.offset = {0, 0};
+      renderPassInfo.renderArea.extent = swapChainExtent;
 
-    VkRenderPassBeginInfo renderPassInfo{};
-    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    renderPassInfo.renderPass = renderPass;
-    renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
-    renderPassInfo.renderArea.offset = {0, 0};
-    renderPassInfo.renderArea.extent = swapChainExtent;
-
-    VkClearValue clearColor = {{{0.2f, 0.2f, 0.2f, 1.0f}}};
-    renderPassInfo.clearValueCount = 1;
-    renderPassInfo.pClearValues = &clearColor;
-
-    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
-                         VK_SUBPASS_CONTENTS_INLINE);
-      vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                        graphicsPipeline);
-
-      VkBuffer vertexBuffers[] = {vertexBuffer};
-      VkDeviceSize offsets[] = {0};
-      vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
-      vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT16);
-      vkCmdDrawIndexed(commandBuffer, indices_size, 1, 0, 0, 0);
-    vkCmdEndRenderPass(commandBuffer);
+      VkClearValue clearColor = {{{0.2f, 0.2f, 0.2f, 1.0f}}};
+      renderPassInfo.clearValueCount = 1;
+      renderPassInfo.pClearValues = &clearColor;
+
+      Profiler::Scope passScope(profiler, commandBuffer, "render pass");
+      if (secondaries.empty()) {
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
+                             VK_SUBPASS_CONTENTS_INLINE);
+        {
+          Profiler::Scope drawScope(profiler, commandBuffer, "draw");
+          draw(commandBuffer, swapChainExtent, scene, 0, scene.queue.size());
+        }
+      } else {
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
+                             VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+        vkCmdExecuteCommands(commandBuffer,
+                             static_cast<uint32_t>(secondaries.size()),
+                             secondaries.data());
+      }
+      vkCmdEndRenderPass(commandBuffer);
+    }
     if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
       throw std::runtime_error(
           "[VkCommands]: I was recording the something cut it off. Please "
           "re-record after you fix recording.!");
     }
   }
+
+  /* Records `count` sorted draws into a secondary that continues
+   * `renderPass`. */
+  static void recordSecondary(const VkCommandBuffer &commandBuffer,
+                              const VkRenderPass &renderPass,
+                              const VkFramebuffer &framebuffer,
+                              const VkExtent2D &extent, const Scene &scene,
+                              size_t first, size_t count) {
+    VkCommandBufferInheritanceInfo inheritance{};
+    inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritance.renderPass = renderPass;
+    inheritance.subpass = 0;
+    inheritance.framebuffer = framebuffer;
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    beginInfo.pInheritanceInfo = &inheritance;
+
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+      throw std::runtime_error("[VkCommands]: Recorder is stuck. Fix it.!");
+    }
+    draw(commandBuffer, extent, scene, first, count);
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+      throw std::runtime_error(
+          "[VkCommands]: A helper thread dropped its recording.!");
+    }
+  }
+
+  /* Viewport, scissor and the instance stream survive the queue's pipeline
+   * changes, so they are set once up front. Secondaries inherit nothing.
+   * The range reaching the end of the queue also draws the scene's tail. */
+  static void draw(const VkCommandBuffer &commandBuffer,
+                   const VkExtent2D &swapChainExtent, const Scene &scene,
+                   size_t first, size_t count) {
+    VkViewport viewport{};
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = (float)swapChainExtent.width;
+    viewport.height = (float)swapChainExtent.height;
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+    VkRect2D scissor{};
+    scissor.offset = {0, 0};
+    scissor.extent = swapChainExtent;
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+    if (scene.instances != VK_NULL_HANDLE) {
+      vkCmdBindVertexBuffers(commandBuffer, Instance::BINDING, 1,
+                             &scene.instances, &scene.instanceOffset);
+    }
+
+    scene.queue.record(commandBuffer, first, count);
+    if (first + count < scene.queue.size()) {
+      return;
+    }
+    if (scene.indirect) {
+      scene.indirect->draw(commandBuffer);
+    }
+    if (scene.sprites) {
+      scene.sprites->record(commandBuffer);
+    }
+  }
 };
 
 #endif // COMMANDS_H_
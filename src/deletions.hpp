@@ -0,0 +1,105 @@
+#ifndef DELETIONS_H_
+#define DELETIONS_H_
+
+#include "allocator.hpp"
+#include "buffers.hpp"
+#include "hostmemory.hpp"
+#include "timeline.hpp"
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <utility>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+/**
+ * Destroys things once the GPU is done with them instead of waiting for it.
+ * Everything is queued with the graphics timeline value of its last use and
+ * goes in bulk, oldest first, when collect() finds that value reached. A
+ * resource replaced at runtime keeps working for the frames still in flight
+ * and the device never has to idle for it.
+ *
+ * Values may lie in the future; the swap chain, say, is only let go by the
+ * presentation engine a few submissions after its last frame.
+ * */
+class DeletionQueue {
+public:
+  void create(const VkDevice &device, Allocator &allocator,
+              Timeline &timeline) {
+    this->device = device;
+    this->allocator = &allocator;
+    this->timeline = &timeline;
+  }
+
+  /* Anything else, e.g. handing a mesh back to its pool. */
+  void defer(uint64_t value, std::function<void()> destroy) {
+    pending.emplace(value, std::move(destroy));
+    deferred++;
+  }
+
+  void buffer(uint64_t value, VkBuffer buffer, Memory memory) {
+    defer(value, [this, buffer, memory]() mutable {
+      Buffers::clean(device, buffer);
+      allocator->free(memory);
+    });
+  }
+
+  void pipeline(uint64_t value, VkPipeline pipeline) {
+    defer(value, [this, pipeline] {
+      vkDestroyPipeline(device, pipeline, HostMemory::callbacks());
+    });
+  }
+
+  void imageViews(uint64_t value, std::vector<VkImageView> imageViews) {
+    defer(value, [this, imageViews = std::move(imageViews)] {
+      for (auto imageView : imageViews) {
+        vkDestroyImageView(device, imageView, HostMemory::callbacks());
+      }
+    });
+  }
+
+  void framebuffers(uint64_t value, std::vector<VkFramebuffer> framebuffers) {
+    defer(value, [this, framebuffers = std::move(framebuffers)] {
+      FrameBuffers::clean(device, framebuffers);
+    });
+  }
+
+  void swapChain(uint64_t value, VkSwapchainKHR swapChain) {
+    defer(value, [this, swapChain] {
+      vkDestroySwapchainKHR(device, swapChain, HostMemory::callbacks());
+    });
+  }
+
+  /* Destroys what the GPU has retired, or everything when `all`, which is
+   * only safe once the device is idle. */
+  void collect(bool all) {
+    while (!pending.empty() &&
+           (all || timeline->reached(pending.begin()->first))) {
+      /* Destroying may queue more, take it out first. */
+      auto destroy = std::move(pending.begin()->second);
+      pending.erase(pending.begin());
+      destroy();
+      destroyed++;
+    }
+  }
+
+  size_t size() const { return pending.size(); }
+
+  void report(std::ostream &out) const {
+    out << "[VkDeletions]: " << destroyed << " of " << deferred
+        << " deferred deletions done, " << pending.size() << " waiting."
+        << std::endl;
+  }
+
+private:
+  VkDevice device = VK_NULL_HANDLE;
+  Allocator *allocator = nullptr;
+  Timeline *timeline = nullptr;
+  /* Equal values keep their order, so things go in the order they came. */
+  std::multimap<uint64_t, std::function<void()>> pending;
+  uint64_t deferred = 0;
+  uint64_t destroyed = 0;
+};
+
+#endif // DELETIONS_H_
@@ -1,5 +1,6 @@
 #ifndef DEVICE_H_
 #define DEVICE_H_
+#include "hostmemory.hpp"
 #include "swapchain.hpp"
 #include "vulkan/vulkan.hpp"
 #include <cstdint>
@@ -18,6 +19,11 @@
 class PhysicalDevice {
 public:
   void pick(const VkInstance &instance, const VkSurfaceKHR &surface) {
+    /* Presenting is the only reason to ask for a swap chain. */
+    if (surface != VK_NULL_HANDLE) {
+      deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    }
+
     uint32_t deviceCount = 0;
     vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
     if (deviceCount == 0) {
@@ -38,11 +44,17 @@ public:
       throw std::runtime_error(
           "[VkDevice]: We can't proceed if you don't have a GPU.");
     }
+
+    /* Optional extensions, enabled when there, never asked for. */
+    budget = supports(physicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    if (budget) {
+      deviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    }
   }
 
   void instantiateLogical(VkDeviceCreateInfo &info, VkDevice &logical) {
-    if (vkCreateDevice(this->physicalDevice, &info, nullptr, &logical) !=
-        VK_SUCCESS) {
+    if (vkCreateDevice(this->physicalDevice, &info, HostMemory::callbacks(),
+                       &logical) != VK_SUCCESS) {
       throw std::runtime_error("[VkDevice]: Logical device...... denied.");
     }
     std::cout << "[VkDevice]: You now have a logical device." << std::endl;
@@ -54,18 +66,23 @@ public:
 
   const VkPhysicalDevice &get() { return physicalDevice; }
 
+  /* VK_EXT_memory_budget is enabled, heaps report what is left. */
+  bool memoryBudget() const { return budget; }
+
 private:
   /* Add extension */
-  const std::vector<const char *> deviceExtensions = {
-      VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+  std::vector<const char *> deviceExtensions;
 
   VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+  bool budget = false;
 
   bool isSuitable(const VkPhysicalDevice &device, const VkSurfaceKHR &surface) {
     QueueFamilyIndices indices = QueueFamilyIndices::find(device, surface);
+    bool featuresSupported = checkFeatureSupport(device);
     bool extensionSupported = checkExtSupport(device);
-    bool swapChainAdequate = false;
-    if (extensionSupported) {
+    bool headless = surface == VK_NULL_HANDLE;
+    bool swapChainAdequate = headless;
+    if (extensionSupported && !headless) {
       SwapChain support;
       support = SwapChain::query(device, surface);
       /* Make sure this device has some supported format and presentation mode
@@ -74,7 +91,26 @@ private:
           !support.formats.empty() && !support.presentModes.empty();
     }
 
-    return indices.isComplete() && extensionSupported && swapChainAdequate;
+    return indices.isComplete(!headless) && featuresSupported && extensionSupported &&
+           swapChainAdequate;
+  }
+
+  /* Frame scheduling is built on Vulkan 1.2 timeline semaphores. */
+  bool checkFeatureSupport(const VkPhysicalDevice &device) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(device, &properties);
+    if (properties.apiVersion < VK_API_VERSION_1_2) {
+      return false;
+    }
+
+    VkPhysicalDeviceVulkan12Features features12{};
+    features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &features12;
+    vkGetPhysicalDeviceFeatures2(device, &features);
+
+    return features12.timelineSemaphore;
   }
 
   bool checkExtSupport(const VkPhysicalDevice &device) {
@@ -95,20 +131,43 @@ private:
 
     return requiredExtensions.empty();
   }
+
+  static bool supports(const VkPhysicalDevice &device, const char *name) {
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount,
+                                         nullptr);
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount,
+                                         availableExtensions.data());
+    for (const auto &extension : availableExtensions) {
+      if (std::string(extension.extensionName) == name) {
+        return true;
+      }
+    }
+    return false;
+  }
 };
 
 class LogicalDevice {
 public:
   void createLogicalDevice(PhysicalDevice &physicalDevice,
                            const VkSurfaceKHR &surface) {
-    QueueFamilyIndices indices =
-        QueueFamilyIndices::find(physicalDevice.get(), surface);
+    indices = QueueFamilyIndices::find(physicalDevice.get(), surface);
 
     /* Queue information. */
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos{};
 
+    /* Headless runs present nowhere and borrow the graphics family. */
+    uint32_t presentFamily =
+        indices.presentFamily.value_or(indices.graphicsFamily.value());
+    /* Without a dedicated copy engine or compute family, graphics does it. */
+    uint32_t transferFamily =
+        indices.transferFamily.value_or(indices.graphicsFamily.value());
+    uint32_t computeFamily =
+        indices.computeFamily.value_or(indices.graphicsFamily.value());
     std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value(),
-                                              indices.presentFamily.value()};
+                                              presentFamily, transferFamily,
+                                              computeFamily};
     float queuePriority = 1.0f;
     for (uint32_t queueFamily : uniqueQueueFamilies) {
       VkDeviceQueueCreateInfo queueCreateInfo{};
@@ -119,12 +178,27 @@ public:
       queueCreateInfos.push_back(queueCreateInfo);
     }
 
-    /* Device features. */
+    /* Device features. Indirect drawing is nice to have, not required. */
+    VkPhysicalDeviceVulkan12Features supported12{};
+    supported12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    VkPhysicalDeviceFeatures2 supported{};
+    supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    supported.pNext = &supported12;
+    vkGetPhysicalDeviceFeatures2(physicalDevice.get(), &supported);
+
     VkPhysicalDeviceFeatures deviceFeatures{};
+    deviceFeatures.multiDrawIndirect = supported.features.multiDrawIndirect;
+    VkPhysicalDeviceVulkan12Features features12{};
+    features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    features12.timelineSemaphore = VK_TRUE;
+    features12.drawIndirectCount = supported12.drawIndirectCount;
+    multiDraw = deviceFeatures.multiDrawIndirect;
+    drawCount = features12.drawIndirectCount;
 
     /* Logical device */
     VkDeviceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    createInfo.pNext = &features12;
     createInfo.pQueueCreateInfos = queueCreateInfos.data();
     createInfo.queueCreateInfoCount =
         static_cast<uint32_t>(queueCreateInfos.size());
@@ -136,14 +210,31 @@ public:
     physicalDevice.instantiateLogical(createInfo, device);
 
     /* Get the queue */
-    vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+    vkGetDeviceQueue(device, presentFamily, 0, &presentQueue);
     vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
+    vkGetDeviceQueue(device, transferFamily, 0, &transferQueue);
+    vkGetDeviceQueue(device, computeFamily, 0, &computeQueue);
   }
 
   VkQueue &queue() { return this->presentQueue; }
   VkQueue &gQueue() { return this->graphicsQueue; }
+  VkQueue &tQueue() { return this->transferQueue; }
+  VkQueue &cQueue() { return this->computeQueue; }
+
+  uint32_t graphicsFamily() const { return indices.graphicsFamily.value(); }
+  uint32_t transferFamily() const {
+    return indices.transferFamily.value_or(graphicsFamily());
+  }
+  uint32_t computeFamily() const {
+    return indices.computeFamily.value_or(graphicsFamily());
+  }
+
+  /* More than one draw per indirect call. */
+  bool multiDrawIndirect() const { return multiDraw; }
+  /* The draw count itself can come from a buffer. */
+  bool drawIndirectCount() const { return drawCount; }
 
-  void clean() { vkDestroyDevice(device, nullptr); }
+  void clean() { vkDestroyDevice(device, HostMemory::callbacks()); }
 
   const VkDevice &get() { return device; }
 
@@ -151,6 +242,11 @@ private:
   VkDevice device;
   VkQueue graphicsQueue;
   VkQueue presentQueue;
+  VkQueue transferQueue;
+  VkQueue computeQueue;
+  QueueFamilyIndices indices;
+  bool multiDraw = false;
+  bool drawCount = false;
 };
 
 #endif // DEVICE_H_
@@ -0,0 +1,51 @@
+#ifndef FRAMES_H_
+#define FRAMES_H_
+
+#include "hostmemory.hpp"
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+/**
+ * Everything a single frame needs while it is being recorded and executed.
+ * Keeping several of these around lets the CPU record frame N+1 while the GPU
+ * is still busy with frame N.
+ * */
+struct Frame {
+  VkSemaphore imageAvailable;
+  VkSemaphore renderFinished;
+  /* Timeline value signaled once the GPU is done with this slot. */
+  uint64_t submitted = 0;
+};
+
+struct Frames {
+  static void create(const VkDevice &device, std::vector<Frame> &frames,
+                     uint32_t count) {
+    frames.resize(count);
+
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    for (auto &frame : frames) {
+      if (vkCreateSemaphore(device, &semaphoreInfo, HostMemory::callbacks(),
+                            &frame.imageAvailable) != VK_SUCCESS ||
+          vkCreateSemaphore(device, &semaphoreInfo, HostMemory::callbacks(),
+                            &frame.renderFinished) != VK_SUCCESS) {
+        throw std::runtime_error(
+            "[VkFrames]: I will mess your pixels. There is no "
+            "way I want to synchronize. It slows me.!");
+      }
+    }
+  }
+
+  static void clean(const VkDevice &device, std::vector<Frame> &frames) {
+    for (auto &frame : frames) {
+      vkDestroySemaphore(device, frame.imageAvailable, HostMemory::callbacks());
+      vkDestroySemaphore(device, frame.renderFinished, HostMemory::callbacks());
+    }
+    frames.clear();
+  }
+};
+
+#endif // FRAMES_H_
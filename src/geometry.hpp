@@ -0,0 +1,273 @@
+#ifndef GEOMETRY_H_
+#define GEOMETRY_H_
+
+#include "allocator.hpp"
+#include "buffers.hpp"
+#include "renderqueue.hpp"
+#include "uploads.hpp"
+#include <cstdint>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+/* Names a mesh in a GeometryPool. Stale handles are caught, not reused. */
+struct MeshHandle {
+  uint32_t index = UINT32_MAX;
+  uint32_t generation = 0;
+};
+
+/* Where a mesh lives inside the pool's two buffers. */
+struct MeshRange {
+  VkDeviceSize vertexBytes = 0;
+  VkDeviceSize vertexSize = 0;
+  VkDeviceSize indexBytes = 0;
+  VkDeviceSize indexSize = 0;
+  /* What an indexed draw of the mesh takes. */
+  uint32_t indexCount = 0;
+  uint32_t firstIndex = 0;
+  int32_t vertexOffset = 0;
+};
+
+/**
+ * First fit over a free list kept sorted by offset, neighbours merge when
+ * they are freed. Good enough for meshes, which come and go in the dozens.
+ * */
+class FreeRanges {
+public:
+  void create(VkDeviceSize size) {
+    ranges.clear();
+    ranges[0] = size;
+  }
+
+  /* The offset of `size` bytes aligned to `alignment`, or false if full. */
+  bool allocate(VkDeviceSize size, VkDeviceSize alignment,
+                VkDeviceSize &offset) {
+    for (auto it = ranges.begin(); it != ranges.end(); it++) {
+      VkDeviceSize start = it->first;
+      VkDeviceSize end = start + it->second;
+      VkDeviceSize aligned = (start + alignment - 1) / alignment * alignment;
+      if (aligned + size > end) {
+        continue;
+      }
+      ranges.erase(it);
+      /* The padding in front and the rest behind go back on the list. */
+      if (aligned > start) {
+        ranges[start] = aligned - start;
+      }
+      if (aligned + size < end) {
+        ranges[aligned + size] = end - aligned - size;
+      }
+      offset = aligned;
+      return true;
+    }
+    return false;
+  }
+
+  void free(VkDeviceSize offset, VkDeviceSize size) {
+    auto next = ranges.lower_bound(offset);
+    if (next != ranges.end() && offset + size == next->first) {
+      size += next->second;
+      next = ranges.erase(next);
+    }
+    if (next != ranges.begin()) {
+      auto previous = std::prev(next);
+      if (previous->first + previous->second == offset) {
+        previous->second += size;
+        return;
+      }
+    }
+    ranges[offset] = size;
+  }
+
+  VkDeviceSize available() const {
+    VkDeviceSize total = 0;
+    for (const auto &range : ranges) {
+      total += range.second;
+    }
+    return total;
+  }
+
+  size_t fragments() const { return ranges.size(); }
+
+private:
+  /* Offset to size. */
+  std::map<VkDeviceSize, VkDeviceSize> ranges;
+};
+
+/**
+ * Every mesh in one vertex buffer and one index buffer, told apart by
+ * vertexOffset and firstIndex. Binding the pair once serves all of them,
+ * which is what lets the render queue skip rebinding between meshes and
+ * one indirect call draw many.
+ *
+ * Vertex types of different sizes share the vertex buffer, each mesh starts
+ * at a multiple of its own stride so vertexOffset counts whole vertices.
+ * Indices are 16 bit, so a mesh holds at most 65536 vertices.
+ * */
+class GeometryPool {
+public:
+  static constexpr VkIndexType INDEX_TYPE = VK_INDEX_TYPE_UINT16;
+
+  void create(const VkDevice &device, Allocator &allocator,
+              Uploader &uploader, VkDeviceSize vertexCapacity,
+              uint32_t indexCapacity) {
+    this->device = device;
+    this->allocator = &allocator;
+    this->uploader = &uploader;
+    this->vertexCapacity = vertexCapacity;
+    this->indexCapacity = sizeof(uint16_t) * VkDeviceSize(indexCapacity);
+
+    Buffers::create(device, vertexBuffer,
+                    static_cast<uint32_t>(this->vertexCapacity),
+                    VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+                        VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    vertexMemory =
+        allocator.allocate(vertexBuffer, Buffers::deviceLocal(allocator));
+    Buffers::create(device, indexBuffer,
+                    static_cast<uint32_t>(this->indexCapacity),
+                    VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+                        VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    indexMemory =
+        allocator.allocate(indexBuffer, Buffers::deviceLocal(allocator));
+    vertexRanges.create(this->vertexCapacity);
+    indexRanges.create(this->indexCapacity);
+  }
+
+  /* Copies a mesh in. Its data is queued on the uploader, or written in
+   * place where the memory allows. */
+  template <typename V>
+  MeshHandle add(const std::vector<V> &vertices,
+                 const std::vector<uint16_t> &indices) {
+    if (vertices.size() > 65536) {
+      throw std::runtime_error(
+          "[VkGeometry]: Too many vertices for 16 bit indices.");
+    }
+    MeshRange range;
+    range.vertexSize = sizeof(V) * vertices.size();
+    range.indexSize = sizeof(uint16_t) * indices.size();
+    if (!vertexRanges.allocate(range.vertexSize, sizeof(V),
+                               range.vertexBytes)) {
+      throw std::runtime_error(
+          "[VkGeometry]: The vertex pool is full. Make it bigger.");
+    }
+    if (!indexRanges.allocate(range.indexSize, sizeof(uint16_t),
+                              range.indexBytes)) {
+      vertexRanges.free(range.vertexBytes, range.vertexSize);
+      throw std::runtime_error(
+          "[VkGeometry]: The index pool is full. Make it bigger.");
+    }
+    range.indexCount = static_cast<uint32_t>(indices.size());
+    range.firstIndex =
+        static_cast<uint32_t>(range.indexBytes / sizeof(uint16_t));
+    range.vertexOffset = static_cast<int32_t>(range.vertexBytes / sizeof(V));
+
+    Buffers::fill(*allocator, *uploader, vertexBuffer, vertexMemory,
+                  range.vertexBytes, vertices.data(), range.vertexSize);
+    Buffers::fill(*allocator, *uploader, indexBuffer, indexMemory,
+                  range.indexBytes, indices.data(), range.indexSize);
+
+    MeshHandle handle;
+    if (!freeSlots.empty()) {
+      handle.index = freeSlots.back();
+      freeSlots.pop_back();
+    } else {
+      handle.index = static_cast<uint32_t>(meshes.size());
+      meshes.push_back({});
+    }
+    Slot &slot = meshes[handle.index];
+    slot.range = range;
+    slot.live = true;
+    handle.generation = slot.generation;
+    return handle;
+  }
+
+  /* Gives the mesh's ranges back. The GPU must be done with it, meshes in
+   * use go through DeletionQueue::defer. */
+  void remove(const MeshHandle &handle) {
+    Slot &slot = at(handle);
+    vertexRanges.free(slot.range.vertexBytes, slot.range.vertexSize);
+    indexRanges.free(slot.range.indexBytes, slot.range.indexSize);
+    slot.live = false;
+    slot.generation++;
+    freeSlots.push_back(handle.index);
+  }
+
+  const MeshRange &range(const MeshHandle &handle) const {
+    return at(handle).range;
+  }
+
+  /* A packet drawing the whole mesh once with `pipeline`. */
+  DrawPacket packet(const MeshHandle &handle,
+                    const VkPipeline &pipeline) const {
+    const MeshRange &mesh = range(handle);
+    DrawPacket packet{};
+    packet.pipeline = pipeline;
+    packet.vertexBuffer = vertexBuffer;
+    packet.indexBuffer = indexBuffer;
+    packet.indexType = INDEX_TYPE;
+    packet.indexCount = mesh.indexCount;
+    packet.firstIndex = mesh.firstIndex;
+    packet.vertexOffset = mesh.vertexOffset;
+    return packet;
+  }
+
+  void report(std::ostream &out) const {
+    out << "[VkGeometry]: " << meshes.size() - freeSlots.size()
+        << " meshes, "
+        << (vertexCapacity - vertexRanges.available()) / 1024 << " of "
+        << vertexCapacity / 1024 << " KiB vertices and "
+        << (indexCapacity - indexRanges.available()) / 1024 << " of "
+        << indexCapacity / 1024 << " KiB indices in use, "
+        << vertexRanges.fragments() + indexRanges.fragments()
+        << " free ranges." << std::endl;
+  }
+
+  void clean() {
+    Buffers::clean(device, vertexBuffer);
+    allocator->free(vertexMemory);
+    Buffers::clean(device, indexBuffer);
+    allocator->free(indexMemory);
+    meshes.clear();
+    freeSlots.clear();
+  }
+
+private:
+  struct Slot {
+    MeshRange range;
+    uint32_t generation = 0;
+    bool live = false;
+  };
+
+  const Slot &at(const MeshHandle &handle) const {
+    if (handle.index >= meshes.size() || !meshes[handle.index].live ||
+        meshes[handle.index].generation != handle.generation) {
+      throw std::runtime_error(
+          "[VkGeometry]: That mesh is gone, or never was.");
+    }
+    return meshes[handle.index];
+  }
+
+  Slot &at(const MeshHandle &handle) {
+    return const_cast<Slot &>(std::as_const(*this).at(handle));
+  }
+
+  VkDevice device = VK_NULL_HANDLE;
+  Allocator *allocator = nullptr;
+  Uploader *uploader = nullptr;
+  VkDeviceSize vertexCapacity = 0;
+  VkDeviceSize indexCapacity = 0;
+  VkBuffer vertexBuffer = VK_NULL_HANDLE;
+  Memory vertexMemory;
+  VkBuffer indexBuffer = VK_NULL_HANDLE;
+  Memory indexMemory;
+  FreeRanges vertexRanges;
+  FreeRanges indexRanges;
+  std::vector<Slot> meshes;
+  std::vector<uint32_t> freeSlots;
+};
+
+#endif // GEOMETRY_H_
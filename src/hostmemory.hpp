@@ -0,0 +1,328 @@
+#ifndef HOSTMEMORY_H_
+#define HOSTMEMORY_H_
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+/**
+ * VkAllocationCallbacks for the driver's own host allocations, routed by
+ * scope and counted.
+ *
+ * Command scope allocations live no longer than the call that made them,
+ * so they come from a bump arena per thread, rewound whenever everything in
+ * it is freed again. No locks, no fragmentation. Everything longer lived
+ * comes from size classes of powers of two up to MAX_POOLED bytes, each with
+ * its own lock and free list over 64 KiB slabs; bigger requests go to
+ * malloc. Calls, bytes and peaks are kept per scope for report().
+ *
+ * One process wide instance. callbacks() is nullptr until enable(), which
+ * has to happen before the instance is created: an object must be destroyed
+ * with the callbacks it was created with.
+ * */
+class HostMemory {
+public:
+  static constexpr size_t SLAB_SIZE = 64 << 10;
+  static constexpr size_t MIN_POOLED = 32;
+  static constexpr size_t MAX_POOLED = 4096;
+  static constexpr uint32_t SCOPES = 5;
+
+  static void enable() { instance().enabled = true; }
+
+  /* What every vkCreate*, vkDestroy*, vkAllocate* and vkFree* gets. */
+  static const VkAllocationCallbacks *callbacks() {
+    HostMemory &host = instance();
+    return host.enabled ? &host.vulkan : nullptr;
+  }
+
+  static void report(std::ostream &out) {
+    HostMemory &host = instance();
+    if (!host.enabled) {
+      return;
+    }
+    static constexpr const char *NAMES[SCOPES] = {"command", "object", "cache",
+                                                  "device", "instance"};
+    for (uint32_t scope = 0; scope < SCOPES; scope++) {
+      const Counters &counters = host.counters[scope];
+      if (counters.allocations == 0 && counters.internal == 0) {
+        continue;
+      }
+      out << "[VkHostMemory]: " << NAMES[scope] << " scope: "
+          << counters.allocations << " allocations, "
+          << counters.reallocations << " reallocations, " << counters.frees
+          << " frees, " << (counters.total >> 10) << " KiB total, "
+          << (counters.peak >> 10) << " KiB peak, " << (counters.live >> 10)
+          << " KiB live, " << counters.internal
+          << " internal allocations." << std::endl;
+    }
+    size_t slabs = 0;
+    for (const auto &pool : host.pools) {
+      slabs += pool.slabs.size();
+    }
+    out << "[VkHostMemory]: " << host.arenas.size() << " thread arenas, "
+        << slabs << " pool slabs, " << host.large << " allocations too big "
+        << "to pool." << std::endl;
+  }
+
+  /* Only once nothing Vulkan is left, the driver's memory goes with it. */
+  static void clean() {
+    HostMemory &host = instance();
+    for (auto &pool : host.pools) {
+      for (void *slab : pool.slabs) {
+        std::free(slab);
+      }
+      pool.slabs.clear();
+      pool.free = nullptr;
+    }
+    for (auto &arena : host.arenas) {
+      std::free(arena->slab);
+    }
+    host.arenas.clear();
+    host.generation++;
+  }
+
+private:
+  enum Source : uint32_t { ARENA, POOL, SYSTEM };
+
+  /* Sits right in front of every pointer handed out. */
+  struct alignas(16) Header {
+    void *raw;
+    size_t size;
+    uint32_t scope;
+    Source source;
+    uint32_t pool;
+  };
+
+  struct Counters {
+    std::atomic<uint64_t> allocations{0};
+    std::atomic<uint64_t> reallocations{0};
+    std::atomic<uint64_t> frees{0};
+    std::atomic<uint64_t> total{0};
+    std::atomic<uint64_t> live{0};
+    std::atomic<uint64_t> peak{0};
+    std::atomic<uint64_t> internal{0};
+  };
+
+  struct Pool {
+    std::mutex mutex;
+    /* Intrusive list through the first bytes of each free chunk. */
+    void *free = nullptr;
+    std::vector<void *> slabs;
+  };
+
+  struct Arena {
+    char *slab = nullptr;
+    size_t head = 0;
+    /* Freed from whichever thread, rewound only by the owner. */
+    std::atomic<uint32_t> live{0};
+  };
+
+  static constexpr uint32_t POOLS = 8; /* 32 B to 4 KiB */
+
+  static HostMemory &instance() {
+    static HostMemory host;
+    return host;
+  }
+
+  HostMemory() {
+    vulkan.pUserData = this;
+    vulkan.pfnAllocation = allocation;
+    vulkan.pfnReallocation = reallocation;
+    vulkan.pfnFree = free;
+    vulkan.pfnInternalAllocation = internalAllocation;
+    vulkan.pfnInternalFree = internalFree;
+  }
+
+  static VKAPI_ATTR void *VKAPI_CALL
+  allocation(void *userData, size_t size, size_t alignment,
+             VkSystemAllocationScope scope) {
+    auto &host = *static_cast<HostMemory *>(userData);
+    host.counters[scope].allocations++;
+    return host.allocate(size, alignment, scope);
+  }
+
+  static VKAPI_ATTR void *VKAPI_CALL
+  reallocation(void *userData, void *original, size_t size, size_t alignment,
+               VkSystemAllocationScope scope) {
+    auto &host = *static_cast<HostMemory *>(userData);
+    if (original == nullptr) {
+      return allocation(userData, size, alignment, scope);
+    }
+    if (size == 0) {
+      free(userData, original);
+      return nullptr;
+    }
+    host.counters[scope].reallocations++;
+    void *moved = host.allocate(size, alignment, scope);
+    if (moved != nullptr) {
+      memcpy(moved, original, std::min(size, header(original)->size));
+      host.release(original);
+    }
+    return moved;
+  }
+
+  static VKAPI_ATTR void VKAPI_CALL free(void *userData, void *memory) {
+    if (memory == nullptr) {
+      return;
+    }
+    auto &host = *static_cast<HostMemory *>(userData);
+    host.counters[header(memory)->scope].frees++;
+    host.release(memory);
+  }
+
+  static VKAPI_ATTR void VKAPI_CALL
+  internalAllocation(void *userData, size_t, VkInternalAllocationType,
+                     VkSystemAllocationScope scope) {
+    static_cast<HostMemory *>(userData)->counters[scope].internal++;
+  }
+
+  static VKAPI_ATTR void VKAPI_CALL
+  internalFree(void *, size_t, VkInternalAllocationType,
+               VkSystemAllocationScope) {}
+
+  static Header *header(void *memory) {
+    return reinterpret_cast<Header *>(memory) - 1;
+  }
+
+  /* Room for the header and the worst case padding in front of it. */
+  static size_t footprint(size_t size, size_t alignment) {
+    return size + sizeof(Header) + std::max(alignment, alignof(Header)) - 1;
+  }
+
+  static void *place(void *raw, size_t size, size_t alignment, uint32_t scope,
+                     Source source, uint32_t pool) {
+    alignment = std::max(alignment, alignof(Header));
+    auto start = reinterpret_cast<uintptr_t>(raw) + sizeof(Header);
+    auto user = (start + alignment - 1) / alignment * alignment;
+    auto memory = reinterpret_cast<void *>(user);
+    *header(memory) = {raw, size, scope, source, pool};
+    return memory;
+  }
+
+  void *allocate(size_t size, size_t alignment,
+                 VkSystemAllocationScope scope) {
+    size_t bytes = footprint(size, alignment);
+    void *memory = nullptr;
+    if (scope == VK_SYSTEM_ALLOCATION_SCOPE_COMMAND && bytes <= SLAB_SIZE) {
+      memory = fromArena(bytes, size, alignment, scope);
+    } else if (bytes <= MAX_POOLED) {
+      memory = fromPool(bytes, size, alignment, scope);
+    } else {
+      memory = fromSystem(bytes, size, alignment, scope);
+    }
+    if (memory != nullptr) {
+      Counters &counter = counters[scope];
+      counter.total += size;
+      uint64_t live = counter.live += size;
+      uint64_t peak = counter.peak;
+      while (live > peak && !counter.peak.compare_exchange_weak(peak, live)) {
+      }
+    }
+    return memory;
+  }
+
+  void release(void *memory) {
+    Header *found = header(memory);
+    counters[found->scope].live -= found->size;
+    switch (found->source) {
+    case ARENA:
+      static_cast<Arena *>(found->raw)->live--;
+      break;
+    case POOL: {
+      /* The chunk starts at raw, the header is only somewhere inside. */
+      void *chunk = found->raw;
+      Pool &pool = pools[found->pool];
+      std::lock_guard<std::mutex> lock(pool.mutex);
+      *static_cast<void **>(chunk) = pool.free;
+      pool.free = chunk;
+      break;
+    }
+    default:
+      std::free(found->raw);
+    }
+  }
+
+  void *fromArena(size_t bytes, size_t size, size_t alignment,
+                  uint32_t scope) {
+    thread_local Arena *arena = nullptr;
+    thread_local uint64_t arenaGeneration = 0;
+    if (arena == nullptr || arenaGeneration != generation) {
+      std::lock_guard<std::mutex> lock(arenasMutex);
+      arenas.push_back(std::make_unique<Arena>());
+      arena = arenas.back().get();
+      arena->slab = static_cast<char *>(std::malloc(SLAB_SIZE));
+      arenaGeneration = generation;
+    }
+    if (arena->live == 0) {
+      arena->head = 0;
+    }
+    if (arena->slab == nullptr || arena->head + bytes > SLAB_SIZE) {
+      /* Still busy from a deeper call, this one goes elsewhere. */
+      return bytes <= MAX_POOLED ? fromPool(bytes, size, alignment, scope)
+                                 : fromSystem(bytes, size, alignment, scope);
+    }
+    char *raw = arena->slab + arena->head;
+    arena->head += bytes;
+    arena->live++;
+    void *memory = place(raw, size, alignment, scope, ARENA, 0);
+    /* Frees find their arena through the header. */
+    header(memory)->raw = arena;
+    return memory;
+  }
+
+  void *fromPool(size_t bytes, size_t size, size_t alignment, uint32_t scope) {
+    uint32_t index = 0;
+    while ((MIN_POOLED << index) < bytes) {
+      index++;
+    }
+    size_t chunk = MIN_POOLED << index;
+    Pool &pool = pools[index];
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    if (pool.free == nullptr) {
+      auto slab = static_cast<char *>(std::malloc(SLAB_SIZE));
+      if (slab == nullptr) {
+        return nullptr;
+      }
+      pool.slabs.push_back(slab);
+      for (size_t offset = SLAB_SIZE; offset >= chunk; offset -= chunk) {
+        void *next = slab + offset - chunk;
+        *static_cast<void **>(next) = pool.free;
+        pool.free = next;
+      }
+    }
+    void *raw = pool.free;
+    pool.free = *static_cast<void **>(raw);
+    return place(raw, size, alignment, scope, POOL, index);
+  }
+
+  void *fromSystem(size_t bytes, size_t size, size_t alignment,
+                   uint32_t scope) {
+    void *raw = std::malloc(bytes);
+    if (raw == nullptr) {
+      return nullptr;
+    }
+    large++;
+    return place(raw, size, alignment, scope, SYSTEM, 0);
+  }
+
+  bool enabled = false;
+  VkAllocationCallbacks vulkan{};
+  std::array<Counters, SCOPES> counters;
+  std::array<Pool, POOLS> pools;
+  std::mutex arenasMutex;
+  std::vector<std::unique_ptr<Arena>> arenas;
+  std::atomic<uint64_t> large{0};
+  /* Bumped by clean(), so threads don't hold on to freed arenas. */
+  std::atomic<uint64_t> generation{1};
+};
+
+#endif // HOSTMEMORY_H_
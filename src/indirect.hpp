@@ -0,0 +1,229 @@
+#ifndef INDIRECT_H_
+#define INDIRECT_H_
+
+#include "allocator.hpp"
+#include "buffers.hpp"
+#include "hostmemory.hpp"
+#include "pipeline.hpp"
+#include "renderqueue.hpp"
+#include "uploads.hpp"
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+/* Mirrors `Object` in shaders/compact.comp. */
+struct IndirectObject {
+  VkDrawIndexedIndirectCommand command;
+  uint32_t visible;
+};
+static_assert(sizeof(IndirectObject) == 24,
+              "IndirectObject has to match the std430 layout of the shader.");
+
+/**
+ * Draws that live on the GPU. Every object keeps its draw command in a
+ * storage buffer; each frame a compute pass packs the visible ones to the
+ * front of the draw buffer, counting them as it goes, and a single
+ * vkCmdDrawIndexedIndirectCount draws whatever came out. Recording costs the
+ * same for ten objects or a million.
+ *
+ * All objects share one pipeline and one vertex/index buffer pair, they
+ * only differ in their ranges. Without drawIndirectCount the draw buffer is
+ * cleared first and drawn in full, culled slots draw zero instances.
+ * */
+class IndirectDraws {
+public:
+  static constexpr uint32_t GROUP_SIZE = 64;
+
+  void create(const VkDevice &device, Allocator &allocator,
+              Uploader &uploader, const VkPipelineCache &cache,
+              const DrawPacket &geometry,
+              const std::vector<IndirectObject> &objects, bool drawCount) {
+    if (objects.empty()) {
+      throw std::runtime_error(
+          "[VkIndirect]: No objects, no buffers. Draw nothing instead.");
+    }
+    this->device = device;
+    this->geometry = geometry;
+    this->drawCount = drawCount;
+    objectCount = static_cast<uint32_t>(objects.size());
+
+    VkDeviceSize objectsSize = sizeof(IndirectObject) * objects.size();
+    VkDeviceSize drawsSize =
+        sizeof(VkDrawIndexedIndirectCommand) * objects.size();
+    Buffers::create(device, objectBuffer, objectsSize,
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                        VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    objectMemory =
+        allocator.allocate(objectBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    Buffers::create(device, drawBuffer, drawsSize,
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                        VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                        VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    drawMemory =
+        allocator.allocate(drawBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    Buffers::create(device, countBuffer, sizeof(uint32_t),
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                        VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                        VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    countMemory =
+        allocator.allocate(countBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    uploader.upload(objectBuffer, 0, objects.data(), objectsSize);
+
+    createDescriptors();
+    Pipeline::createCompute(device, cache, Pipeline::compiled("compact.spv"),
+                            setLayout, sizeof(uint32_t), pipelineLayout,
+                            pipeline);
+  }
+
+  /* Fills the draw buffer for this frame. Outside of a render pass. */
+  void compact(const VkCommandBuffer &commandBuffer) const {
+    /* The previous frame may still be drawing from these buffers. */
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                         nullptr, 0, nullptr);
+    vkCmdFillBuffer(commandBuffer, countBuffer, 0, sizeof(uint32_t), 0);
+    if (!drawCount) {
+      vkCmdFillBuffer(commandBuffer, drawBuffer, 0, VK_WHOLE_SIZE, 0);
+    }
+
+    VkMemoryBarrier cleared{};
+    cleared.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    cleared.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    cleared.dstAccessMask =
+        VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &cleared,
+                         0, nullptr, 0, nullptr);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                            pipelineLayout, 0, 1, &set, 0, nullptr);
+    vkCmdPushConstants(commandBuffer, pipelineLayout,
+                       VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t),
+                       &objectCount);
+    vkCmdDispatch(commandBuffer, (objectCount + GROUP_SIZE - 1) / GROUP_SIZE,
+                  1, 1);
+
+    VkMemoryBarrier compacted{};
+    compacted.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    compacted.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    compacted.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1, &compacted,
+                         0, nullptr, 0, nullptr);
+  }
+
+  /* Draws whatever compact() left behind. Inside the render pass. */
+  void draw(const VkCommandBuffer &commandBuffer) const {
+    StateTracker tracker;
+    tracker.bind(commandBuffer, geometry);
+    if (drawCount) {
+      vkCmdDrawIndexedIndirectCount(commandBuffer, drawBuffer, 0, countBuffer,
+                                    0, objectCount,
+                                    sizeof(VkDrawIndexedIndirectCommand));
+    } else {
+      vkCmdDrawIndexedIndirect(commandBuffer, drawBuffer, 0, objectCount,
+                               sizeof(VkDrawIndexedIndirectCommand));
+    }
+  }
+
+  uint32_t size() const { return objectCount; }
+
+  void clean(Allocator &allocator) {
+    vkDestroyPipeline(device, pipeline, HostMemory::callbacks());
+    vkDestroyPipelineLayout(device, pipelineLayout, HostMemory::callbacks());
+    vkDestroyDescriptorPool(device, descriptorPool, HostMemory::callbacks());
+    vkDestroyDescriptorSetLayout(device, setLayout, HostMemory::callbacks());
+    Buffers::clean(device, countBuffer);
+    allocator.free(countMemory);
+    Buffers::clean(device, drawBuffer);
+    allocator.free(drawMemory);
+    Buffers::clean(device, objectBuffer);
+    allocator.free(objectMemory);
+  }
+
+private:
+  /* Objects, draws and the count, in the shader's binding order. */
+  void createDescriptors() {
+    std::array<VkDescriptorSetLayoutBinding, 3> bindings{};
+    for (uint32_t i = 0; i < bindings.size(); i++) {
+      bindings[i].binding = i;
+      bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      bindings[i].descriptorCount = 1;
+      bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+    if (vkCreateDescriptorSetLayout(device, &layoutInfo,
+                                    HostMemory::callbacks(),
+                                    &setLayout) != VK_SUCCESS) {
+      throw std::runtime_error(
+          "[VkIndirect]: The shader won't know where its buffers are.");
+    }
+
+    VkDescriptorPoolSize poolSize{};
+    poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSize.descriptorCount = static_cast<uint32_t>(bindings.size());
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.maxSets = 1;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    if (vkCreateDescriptorPool(device, &poolInfo, HostMemory::callbacks(),
+                               &descriptorPool) != VK_SUCCESS) {
+      throw std::runtime_error("[VkIndirect]: No pool for descriptors.");
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &setLayout;
+    if (vkAllocateDescriptorSets(device, &allocInfo, &set) != VK_SUCCESS) {
+      throw std::runtime_error("[VkIndirect]: The descriptor pool is dry.");
+    }
+
+    std::array<VkDescriptorBufferInfo, 3> infos{};
+    infos[0] = {objectBuffer, 0, VK_WHOLE_SIZE};
+    infos[1] = {drawBuffer, 0, VK_WHOLE_SIZE};
+    infos[2] = {countBuffer, 0, VK_WHOLE_SIZE};
+    std::array<VkWriteDescriptorSet, 3> writes{};
+    for (uint32_t i = 0; i < writes.size(); i++) {
+      writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      writes[i].dstSet = set;
+      writes[i].dstBinding = i;
+      writes[i].descriptorCount = 1;
+      writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      writes[i].pBufferInfo = &infos[i];
+    }
+    vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()),
+                           writes.data(), 0, nullptr);
+  }
+
+  VkDevice device = VK_NULL_HANDLE;
+  DrawPacket geometry;
+  bool drawCount = false;
+  uint32_t objectCount = 0;
+
+  VkBuffer objectBuffer = VK_NULL_HANDLE;
+  Memory objectMemory;
+  VkBuffer drawBuffer = VK_NULL_HANDLE;
+  Memory drawMemory;
+  VkBuffer countBuffer = VK_NULL_HANDLE;
+  Memory countMemory;
+
+  VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+  VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+  VkDescriptorSet set = VK_NULL_HANDLE;
+  VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+  VkPipeline pipeline = VK_NULL_HANDLE;
+};
+
+#endif // INDIRECT_H_
@@ -0,0 +1,252 @@
+#ifndef LAYOUT_H_
+#define LAYOUT_H_
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <type_traits>
+#include <vulkan/vulkan_core.h>
+
+/**
+ * Vertex input state derived from the vertex structs themselves. A vertex
+ * type lists its members once,
+ *
+ *   static constexpr auto fields() {
+ *     return std::array{VERTEX_FIELD(Vertex, pos), VERTEX_FIELD(Vertex, color)};
+ *   }
+ *
+ * and formats, offsets, strides and locations all follow at compile time.
+ * Types without a VkFormat don't compile. Streams advancing per instance
+ * say so with `static constexpr VkVertexInputRate RATE`.
+ * */
+
+/* Integer components the shader reads as floats in [0, 1] or [-1, 1]. */
+template <typename T> struct Normalized {
+  T value;
+};
+
+/* IEEE half floats, stored as their bits. */
+template <int N> struct Half {
+  uint16_t bits[N];
+};
+
+/* x, y, z in 10 bits each and w in 2, the usual home of normals. */
+struct Snorm1010102 {
+  uint32_t bits;
+};
+struct Unorm1010102 {
+  uint32_t bits;
+};
+
+struct VertexFormats {
+  /* `N` components of `C`, read as floats when `normalized`. */
+  template <typename C, bool normalized> static constexpr VkFormat of(int n) {
+    if constexpr (std::is_same_v<C, float>) {
+      static_assert(!normalized, "[VkVertexLayout]: Floats are no integers.");
+      constexpr VkFormat formats[] = {
+          VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT,
+          VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT};
+      return formats[n - 1];
+    } else if constexpr (std::is_same_v<C, int32_t>) {
+      static_assert(!normalized, "[VkVertexLayout]: No 32 bit SNORM.");
+      constexpr VkFormat formats[] = {
+          VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT,
+          VK_FORMAT_R32G32B32A32_SINT};
+      return formats[n - 1];
+    } else if constexpr (std::is_same_v<C, uint32_t>) {
+      static_assert(!normalized, "[VkVertexLayout]: No 32 bit UNORM.");
+      constexpr VkFormat formats[] = {
+          VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT,
+          VK_FORMAT_R32G32B32A32_UINT};
+      return formats[n - 1];
+    } else if constexpr (std::is_same_v<C, int16_t>) {
+      constexpr VkFormat ints[] = {
+          VK_FORMAT_R16_SINT, VK_FORMAT_R16G16_SINT, VK_FORMAT_R16G16B16_SINT,
+          VK_FORMAT_R16G16B16A16_SINT};
+      constexpr VkFormat norms[] = {
+          VK_FORMAT_R16_SNORM, VK_FORMAT_R16G16_SNORM,
+          VK_FORMAT_R16G16B16_SNORM, VK_FORMAT_R16G16B16A16_SNORM};
+      return normalized ? norms[n - 1] : ints[n - 1];
+    } else if constexpr (std::is_same_v<C, uint16_t>) {
+      constexpr VkFormat ints[] = {
+          VK_FORMAT_R16_UINT, VK_FORMAT_R16G16_UINT, VK_FORMAT_R16G16B16_UINT,
+          VK_FORMAT_R16G16B16A16_UINT};
+      constexpr VkFormat norms[] = {
+          VK_FORMAT_R16_UNORM, VK_FORMAT_R16G16_UNORM,
+          VK_FORMAT_R16G16B16_UNORM, VK_FORMAT_R16G16B16A16_UNORM};
+      return normalized ? norms[n - 1] : ints[n - 1];
+    } else if constexpr (std::is_same_v<C, int8_t>) {
+      constexpr VkFormat ints[] = {VK_FORMAT_R8_SINT, VK_FORMAT_R8G8_SINT,
+                                   VK_FORMAT_R8G8B8_SINT,
+                                   VK_FORMAT_R8G8B8A8_SINT};
+      constexpr VkFormat norms[] = {VK_FORMAT_R8_SNORM, VK_FORMAT_R8G8_SNORM,
+                                    VK_FORMAT_R8G8B8_SNORM,
+                                    VK_FORMAT_R8G8B8A8_SNORM};
+      return normalized ? norms[n - 1] : ints[n - 1];
+    } else if constexpr (std::is_same_v<C, uint8_t>) {
+      constexpr VkFormat ints[] = {VK_FORMAT_R8_UINT, VK_FORMAT_R8G8_UINT,
+                                   VK_FORMAT_R8G8B8_UINT,
+                                   VK_FORMAT_R8G8B8A8_UINT};
+      constexpr VkFormat norms[] = {VK_FORMAT_R8_UNORM, VK_FORMAT_R8G8_UNORM,
+                                    VK_FORMAT_R8G8B8_UNORM,
+                                    VK_FORMAT_R8G8B8A8_UNORM};
+      return normalized ? norms[n - 1] : ints[n - 1];
+    } else {
+      static_assert(sizeof(C) == 0,
+                    "[VkVertexLayout]: No VkFormat for this component type.");
+      return VK_FORMAT_UNDEFINED;
+    }
+  }
+};
+
+/* The VkFormat of a member type. Unmapped types stop the build. */
+template <typename T> struct VertexFormat {
+  static constexpr VkFormat value = VertexFormats::of<T, false>(1);
+};
+template <typename T> struct VertexFormat<Normalized<T>> {
+  static constexpr VkFormat value = VertexFormats::of<T, true>(1);
+};
+template <int N, typename C> struct VertexFormat<glm::vec<N, C>> {
+  static constexpr VkFormat value = VertexFormats::of<C, false>(N);
+};
+template <int N, typename C> struct VertexFormat<Normalized<glm::vec<N, C>>> {
+  static constexpr VkFormat value = VertexFormats::of<C, true>(N);
+};
+template <int N> struct VertexFormat<Half<N>> {
+  static_assert(N >= 1 && N <= 4, "[VkVertexLayout]: Halves come in 1 to 4.");
+  static constexpr VkFormat value =
+      std::array{VK_FORMAT_R16_SFLOAT, VK_FORMAT_R16G16_SFLOAT,
+                 VK_FORMAT_R16G16B16_SFLOAT, VK_FORMAT_R16G16B16A16_SFLOAT}[N - 1];
+};
+template <> struct VertexFormat<Snorm1010102> {
+  static constexpr VkFormat value = VK_FORMAT_A2B10G10R10_SNORM_PACK32;
+};
+template <> struct VertexFormat<Unorm1010102> {
+  static constexpr VkFormat value = VK_FORMAT_A2B10G10R10_UNORM_PACK32;
+};
+
+/* One member of a vertex struct. */
+struct VertexField {
+  VkFormat format;
+  uint32_t offset;
+};
+
+/* Only usable where `Type` is complete, like inside its member functions. */
+#define VERTEX_FIELD(Type, member)                                             \
+  VertexField {                                                                \
+    VertexFormat<decltype(Type::member)>::value,                               \
+        static_cast<uint32_t>(offsetof(Type, member))                          \
+  }
+
+/* Binding and attributes of a single vertex type. */
+template <typename V> struct VertexLayout {
+  static constexpr auto fields = V::fields();
+  static constexpr uint32_t size = static_cast<uint32_t>(fields.size());
+
+  static constexpr VkVertexInputRate rate() {
+    if constexpr (requires { V::RATE; }) {
+      return V::RATE;
+    } else {
+      return VK_VERTEX_INPUT_RATE_VERTEX;
+    }
+  }
+
+  static constexpr VkVertexInputBindingDescription binding(uint32_t binding) {
+    VkVertexInputBindingDescription description{};
+    description.binding = binding;
+    description.stride = sizeof(V);
+    description.inputRate = rate();
+    return description;
+  }
+
+  /* Locations are handed out in member order, from `firstLocation` on. */
+  static constexpr std::array<VkVertexInputAttributeDescription, size>
+  attributes(uint32_t binding, uint32_t firstLocation) {
+    std::array<VkVertexInputAttributeDescription, size> descriptions{};
+    for (uint32_t i = 0; i < size; i++) {
+      descriptions[i].binding = binding;
+      descriptions[i].location = firstLocation + i;
+      descriptions[i].format = fields[i].format;
+      descriptions[i].offset = fields[i].offset;
+    }
+    return descriptions;
+  }
+};
+
+/**
+ * The vertex input of a pipeline fed by `Streams`, one binding each in
+ * order. Attribute locations continue across streams, so a shader reading
+ * Vertex and Instance finds Instance's first member right after Vertex's
+ * last.
+ * */
+template <typename... Streams> struct VertexInput {
+  static constexpr uint32_t ATTRIBUTES = (VertexLayout<Streams>::size + ...);
+
+  static constexpr std::array<VkVertexInputBindingDescription,
+                              sizeof...(Streams)>
+  bindings() {
+    uint32_t binding = 0;
+    return {VertexLayout<Streams>::binding(binding++)...};
+  }
+
+  static constexpr std::array<VkVertexInputAttributeDescription, ATTRIBUTES>
+  attributes() {
+    std::array<VkVertexInputAttributeDescription, ATTRIBUTES> descriptions{};
+    uint32_t binding = 0;
+    uint32_t location = 0;
+    (
+        [&] {
+          for (const auto &attribute :
+               VertexLayout<Streams>::attributes(binding, location)) {
+            descriptions[location++] = attribute;
+          }
+          binding++;
+        }(),
+        ...);
+    return descriptions;
+  }
+};
+
+/* Float to IEEE half, round to nearest even. */
+struct HalfFloat {
+  static constexpr uint16_t pack(float value) {
+    uint32_t bits = std::bit_cast<uint32_t>(value);
+    auto sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+    int32_t exponent = static_cast<int32_t>((bits >> 23) & 0xff) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffff;
+
+    if (((bits >> 23) & 0xff) == 0xff) {
+      /* Infinity stays infinity, NaN stays some NaN. */
+      return static_cast<uint16_t>(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+    }
+    if (exponent >= 31) {
+      return static_cast<uint16_t>(sign | 0x7c00);
+    }
+    if (exponent <= 0) {
+      if (exponent < -10) {
+        return sign;
+      }
+      /* Subnormal, the implicit one becomes explicit. */
+      mantissa |= 0x800000;
+      uint32_t shift = static_cast<uint32_t>(14 - exponent);
+      uint32_t half = mantissa >> shift;
+      uint32_t rest = mantissa & ((1u << shift) - 1);
+      uint32_t midpoint = 1u << (shift - 1);
+      if (rest > midpoint || (rest == midpoint && (half & 1))) {
+        half++;
+      }
+      return static_cast<uint16_t>(sign | half);
+    }
+    uint32_t half = static_cast<uint32_t>(exponent) << 10 | mantissa >> 13;
+    uint32_t rest = mantissa & 0x1fff;
+    /* A carry out of the mantissa bumps the exponent, which is right. */
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) {
+      half++;
+    }
+    return static_cast<uint16_t>(sign | half);
+  }
+};
+
+#endif // LAYOUT_H_
@@ -6,10 +6,10 @@
 #define GLFW_FORCE_RADIANS
 #include <iostream>
 
-int main() {
+int main(int argc, char **argv) {
 
-  App::VkApp app;
   try {
+    App::VkApp app(Options::parse(argc, argv));
     app.run();
   } catch (std::exception& e) {
     // As soon as we except any fatal error, print it out.
@@ -0,0 +1,194 @@
+#ifndef MEMORYTYPES_H_
+#define MEMORYTYPES_H_
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+/**
+ * What a caller wants from a memory type. `required` flags must be there,
+ * `preferred` ones should, `avoided` ones shouldn't. Plain property flags
+ * convert to a request that only requires them.
+ * */
+struct MemoryRequest {
+  VkMemoryPropertyFlags required = 0;
+  VkMemoryPropertyFlags preferred = 0;
+  VkMemoryPropertyFlags avoided = 0;
+
+  constexpr MemoryRequest(VkMemoryPropertyFlags required,
+                          VkMemoryPropertyFlags preferred = 0,
+                          VkMemoryPropertyFlags avoided = 0)
+      : required(required), preferred(preferred), avoided(avoided) {}
+};
+
+/**
+ * The memory types and heaps of one device, queried once. Types are ranked
+ * per request: fewest preferred flags missing, then fewest avoided flags
+ * present, then fewest flags nobody asked for, so device local buffers stay
+ * off host visible types and staging stays off device local ones when the
+ * device lets us.
+ *
+ * Heaps are tracked against a budget. With VK_EXT_memory_budget that is the
+ * driver's figure, refreshed whenever we allocate or free a block; without
+ * it we assume 80% of the heap is ours to take. The Allocator walks the
+ * ranked types and only asks fits() when it is about to allocate a new
+ * block, for the size of that block; when no heap has room it takes the
+ * best type anyway and says so through overBudget(), the driver may still
+ * cope.
+ * */
+class MemoryTypes {
+public:
+  /* Share of a heap assumed available without the budget extension. */
+  static constexpr VkDeviceSize BUDGET_PERCENT = 80;
+
+  void create(const VkPhysicalDevice &physicalDevice, bool budgetExtension) {
+    this->physicalDevice = physicalDevice;
+    this->budgetExtension = budgetExtension;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &properties);
+    tracked.fill(0);
+    fallbacks = 0;
+    refresh();
+  }
+
+  VkMemoryPropertyFlags flags(uint32_t memoryType) const {
+    return properties.memoryTypes[memoryType].propertyFlags;
+  }
+
+  uint32_t heap(uint32_t memoryType) const {
+    return properties.memoryTypes[memoryType].heapIndex;
+  }
+
+  /**
+   * Whether the CPU can write all of video memory directly: some device
+   * local type is host visible and coherent, and its heap is as large as
+   * the largest device local heap. True on UMA and software devices, and on
+   * discrete cards with resizable BAR. The classic 256 MiB BAR window does
+   * not count, it is too small to hold more than the odd dynamic buffer.
+   * */
+  bool directWrites() const {
+    constexpr VkMemoryPropertyFlags DIRECT =
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT |
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    VkDeviceSize largest = 0;
+    VkDeviceSize mappable = 0;
+    for (uint32_t i = 0; i < properties.memoryTypeCount; i++) {
+      if (!(flags(i) & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) {
+        continue;
+      }
+      VkDeviceSize size = properties.memoryHeaps[heap(i)].size;
+      largest = std::max(largest, size);
+      if ((flags(i) & DIRECT) == DIRECT) {
+        mappable = std::max(mappable, size);
+      }
+    }
+    return mappable > 0 && mappable == largest;
+  }
+
+  /* The types out of `typeBits` that have what `request` requires, best
+   * first. Never empty. */
+  std::vector<uint32_t> ranked(uint32_t typeBits,
+                               const MemoryRequest &request) const {
+    std::vector<uint32_t> result;
+    for (uint32_t i = 0; i < properties.memoryTypeCount; i++) {
+      if ((typeBits & (1u << i)) &&
+          (flags(i) & request.required) == request.required) {
+        result.push_back(i);
+      }
+    }
+    if (result.empty()) {
+      throw std::runtime_error(
+          "[VkMemory]: failed to find suitable memory type!");
+    }
+    std::stable_sort(result.begin(), result.end(),
+                     [&](uint32_t l, uint32_t r) {
+                       return rank(flags(l), request) < rank(flags(r), request);
+                     });
+    return result;
+  }
+
+  /* Whether the heap of `memoryType` has room for `size` more bytes. */
+  bool fits(uint32_t memoryType, VkDeviceSize size) const {
+    uint32_t index = heap(memoryType);
+    return usage[index] + size <= budget[index];
+  }
+
+  /* A block went to a heap over its budget for lack of a better one. */
+  void overBudget() { fallbacks++; }
+
+  /* Follows our own device allocations as they come and go. */
+  void track(uint32_t memoryType, VkDeviceSize size, bool allocated) {
+    uint32_t index = heap(memoryType);
+    if (allocated) {
+      tracked[index] += size;
+    } else {
+      tracked[index] -= std::min(tracked[index], size);
+    }
+    refresh();
+  }
+
+  /* Re-reads the budget. Other processes move it too, so now and then is
+   * not enough; every allocation of ours is a good moment. */
+  void refresh() {
+    if (!budgetExtension) {
+      for (uint32_t i = 0; i < properties.memoryHeapCount; i++) {
+        budget[i] = properties.memoryHeaps[i].size * BUDGET_PERCENT / 100;
+        usage[i] = tracked[i];
+      }
+      return;
+    }
+
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{};
+    budgetProperties.sType =
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+    VkPhysicalDeviceMemoryProperties2 properties2{};
+    properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+    properties2.pNext = &budgetProperties;
+    vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &properties2);
+    for (uint32_t i = 0; i < properties.memoryHeapCount; i++) {
+      budget[i] = budgetProperties.heapBudget[i];
+      usage[i] = budgetProperties.heapUsage[i];
+    }
+  }
+
+  void report(std::ostream &out) const {
+    for (uint32_t i = 0; i < properties.memoryHeapCount; i++) {
+      bool local =
+          properties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+      out << "[VkMemory]: Heap " << i << (local ? " (device local)" : "")
+          << ": " << (usage[i] >> 20) << " of " << (budget[i] >> 20)
+          << " MiB budget in use, " << (tracked[i] >> 20) << " MiB ours."
+          << std::endl;
+    }
+    if (fallbacks > 0) {
+      out << "[VkMemory]: Went over budget " << fallbacks
+          << " times for lack of a better heap." << std::endl;
+    }
+  }
+
+private:
+  /* Lower is better, the criteria in order of importance. */
+  static uint64_t rank(VkMemoryPropertyFlags typeFlags,
+                       const MemoryRequest &request) {
+    uint64_t missing = std::popcount(request.preferred & ~typeFlags);
+    uint64_t unwanted = std::popcount(request.avoided & typeFlags);
+    uint64_t extra = std::popcount(
+        typeFlags & ~(request.required | request.preferred));
+    return missing << 16 | unwanted << 8 | extra;
+  }
+
+  VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+  bool budgetExtension = false;
+  VkPhysicalDeviceMemoryProperties properties{};
+  std::array<VkDeviceSize, VK_MAX_MEMORY_HEAPS> budget{};
+  std::array<VkDeviceSize, VK_MAX_MEMORY_HEAPS> usage{};
+  std::array<VkDeviceSize, VK_MAX_MEMORY_HEAPS> tracked{};
+  uint32_t fallbacks = 0;
+};
+
+#endif // MEMORYTYPES_H_
@@ -0,0 +1,67 @@
+#ifndef OFFSCREEN_H_
+#define OFFSCREEN_H_
+
+#include "allocator.hpp"
+#include "hostmemory.hpp"
+#include "settings.hpp"
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+/**
+ * Device local images that stand in for swap chain images when there is no
+ * window to present to. Rendering is identical, the results simply stay on
+ * the GPU (or get copied out for inspection).
+ * */
+struct Offscreen {
+  static constexpr VkFormat FORMAT = VK_FORMAT_R8G8B8A8_UNORM;
+
+  static void create(const VkDevice &device, Allocator &allocator,
+                     uint32_t count, std::vector<VkImage> &images,
+                     std::vector<Memory> &imagesMemory,
+                     VkFormat &imageFormat, VkExtent2D &extent) {
+    imageFormat = FORMAT;
+    extent = {WIDTH, HEIGHT};
+    images.resize(count);
+    imagesMemory.resize(count);
+
+    for (uint32_t i = 0; i < count; i++) {
+      VkImageCreateInfo imageInfo{};
+      imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+      imageInfo.imageType = VK_IMAGE_TYPE_2D;
+      imageInfo.format = imageFormat;
+      imageInfo.extent = {extent.width, extent.height, 1};
+      imageInfo.mipLevels = 1;
+      imageInfo.arrayLayers = 1;
+      imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+      imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+      /* Transfer source so frames can be read back. */
+      imageInfo.usage =
+          VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+      imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+      imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+      if (vkCreateImage(device, &imageInfo, HostMemory::callbacks(),
+                        &images[i]) != VK_SUCCESS) {
+        throw std::runtime_error(
+            "[VkOffscreen]: No window and no image. Where do I draw?");
+      }
+      imagesMemory[i] =
+          allocator.allocate(images[i], VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    }
+  }
+
+  static void clean(const VkDevice &device, Allocator &allocator,
+                    std::vector<VkImage> &images,
+                    std::vector<Memory> &imagesMemory) {
+    for (size_t i = 0; i < images.size(); i++) {
+      vkDestroyImage(device, images[i], HostMemory::callbacks());
+      allocator.free(imagesMemory[i]);
+    }
+    images.clear();
+    imagesMemory.clear();
+  }
+};
+
+#endif // OFFSCREEN_H_
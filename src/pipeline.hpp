@@ -1,5 +1,6 @@
 #ifndef PIPELINE_H_
 #define PIPELINE_H_
+#include "hostmemory.hpp"
 #include "vertex.hpp"
 #include <cstddef>
 #include <cstdint>
@@ -29,11 +30,61 @@ struct Pipeline {
     return buffer;
   }
 
-  static void create(const VkDevice &device, const VkExtent2D &swapChainExtent,
+  /* A shader the build compiled, see SHADER_BINARY_DIR in CMakeLists.txt. */
+  static std::filesystem::path compiled(const char *name) {
+    return std::filesystem::path(SHADER_BINARY_DIR) / name;
+  }
+
+  static void create(const VkDevice &device, const VkPipelineCache &cache,
+                     VkPipelineLayout &pipelineLayout, VkRenderPass &renderPass,
+                     VkPipeline &graphicsPipeline) {
+    create<Vertex>(device, cache, std::filesystem::path("../shaders/vert.spv"),
+                   pipelineLayout, renderPass, graphicsPipeline);
+  }
+
+  /* Same as create(), plus a per instance stream at Instance::BINDING. */
+  static void createInstanced(const VkDevice &device,
+                              const VkPipelineCache &cache,
+                              VkPipelineLayout &pipelineLayout,
+                              VkRenderPass &renderPass,
+                              VkPipeline &graphicsPipeline) {
+    static_assert(VertexInput<Vertex, Instance>::bindings()[Instance::BINDING]
+                          .inputRate == VK_VERTEX_INPUT_RATE_INSTANCE,
+                  "[VkPipeline]: Instance::BINDING is off.");
+    create<Vertex, Instance>(device, cache, compiled("instanced.spv"),
+                             pipelineLayout, renderPass, graphicsPipeline);
+  }
+
+  /* Same as create(), reading PackedVertex. */
+  static void createPacked(const VkDevice &device, const VkPipelineCache &cache,
+                           VkPipelineLayout &pipelineLayout,
+                           VkRenderPass &renderPass,
+                           VkPipeline &graphicsPipeline) {
+    create<PackedVertex>(device, cache, compiled("packed.spv"), pipelineLayout,
+                         renderPass, graphicsPipeline);
+  }
+
+  /* A pipeline whose vertex input comes from `Streams`, see VertexInput. */
+  template <typename... Streams>
+  static void create(const VkDevice &device, const VkPipelineCache &cache,
+                     const std::filesystem::path &vertShader,
                      VkPipelineLayout &pipelineLayout, VkRenderPass &renderPass,
                      VkPipeline &graphicsPipeline) {
-    auto vertShaderCode =
-        readFile(std::filesystem::path("../shaders/vert.spv"));
+    constexpr auto bindings = VertexInput<Streams...>::bindings();
+    constexpr auto attributes = VertexInput<Streams...>::attributes();
+    create(device, cache, vertShader, {bindings.begin(), bindings.end()},
+           {attributes.begin(), attributes.end()}, pipelineLayout, renderPass,
+           graphicsPipeline);
+  }
+
+  static void
+  create(const VkDevice &device, const VkPipelineCache &cache,
+         const std::filesystem::path &vertShader,
+         const std::vector<VkVertexInputBindingDescription> &bindings,
+         const std::vector<VkVertexInputAttributeDescription> &attributes,
+         VkPipelineLayout &pipelineLayout, VkRenderPass &renderPass,
+         VkPipeline &graphicsPipeline) {
+    auto vertShaderCode = readFile(vertShader);
     auto fragShaderCode =
         readFile(std::filesystem::path("../shaders/frag.spv"));
 
@@ -59,17 +110,15 @@ struct Pipeline {
     VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo,
                                                       fragShaderStageInfo};
 
-    auto bindDescription = Vertex::getBindingDescription();
-    auto attrDescription = Vertex::getAttributeDescriptions();
-
     VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
     vertexInputInfo.sType =
         VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertexInputInfo.vertexBindingDescriptionCount = 1;
+    vertexInputInfo.vertexBindingDescriptionCount =
+        static_cast<uint32_t>(bindings.size());
     vertexInputInfo.vertexAttributeDescriptionCount =
-        static_cast<uint32_t>(attrDescription.size());
-    vertexInputInfo.pVertexAttributeDescriptions = attrDescription.data();
-    vertexInputInfo.pVertexBindingDescriptions = &bindDescription;
+        static_cast<uint32_t>(attributes.size());
+    vertexInputInfo.pVertexAttributeDescriptions = attributes.data();
+    vertexInputInfo.pVertexBindingDescriptions = bindings.data();
 
     VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
     inputAssembly.sType =
@@ -77,24 +126,20 @@ struct Pipeline {
     inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
     inputAssembly.primitiveRestartEnable = VK_FALSE;
 
-    VkViewport viewport{};
-    viewport.x = 0.0f;
-    viewport.y = 0.0f;
-    viewport.width = (float)swapChainExtent.width;
-    viewport.height = (float)swapChainExtent.height;
-    viewport.minDepth = 0.0f;
-    viewport.maxDepth = 1.0f;
-
-    VkRect2D scissor{};
-    scissor.offset = {0, 0};
-    scissor.extent = swapChainExtent;
+    /* Viewport and scissor are set while recording, so the pipeline survives
+     * a window resize. */
+    std::vector<VkDynamicState> dynamicStates = {VK_DYNAMIC_STATE_VIEWPORT,
+                                                 VK_DYNAMIC_STATE_SCISSOR};
+    VkPipelineDynamicStateCreateInfo dynamicState{};
+    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicState.dynamicStateCount =
+        static_cast<uint32_t>(dynamicStates.size());
+    dynamicState.pDynamicStates = dynamicStates.data();
 
     VkPipelineViewportStateCreateInfo viewportState{};
     viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
     viewportState.viewportCount = 1;
-    viewportState.pViewports = &viewport;
     viewportState.scissorCount = 1;
-    viewportState.pScissors = &scissor;
 
     VkPipelineRasterizationStateCreateInfo rasterizer{};
     rasterizer.sType =
@@ -136,7 +181,8 @@ struct Pipeline {
     pipelineLayoutInfo.setLayoutCount = 0;
     pipelineLayoutInfo.pushConstantRangeCount = 0;
 
-    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr,
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo,
+                               HostMemory::callbacks(),
                                &pipelineLayout) != VK_SUCCESS) {
       throw std::runtime_error(
           "[VkPipeline]: I tried, okay? But I can't create pipeline at all.!");
@@ -153,15 +199,16 @@ struct Pipeline {
     pipelineInfo.pViewportState = &viewportState;
     pipelineInfo.pRasterizationState = &rasterizer;
     pipelineInfo.pMultisampleState = &multisampling;
-    // pipelineInfo.pDynamicState = &dynamicState;
+    pipelineInfo.pDynamicState = &dynamicState;
     pipelineInfo.pColorBlendState = &colorBlending;
     pipelineInfo.layout = pipelineLayout;
     pipelineInfo.renderPass = renderPass;
     pipelineInfo.subpass = 0;
     pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
-    if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo,
-                                  nullptr, &graphicsPipeline) != VK_SUCCESS) {
+    if (vkCreateGraphicsPipelines(device, cache, 1, &pipelineInfo,
+                                  HostMemory::callbacks(),
+                                  &graphicsPipeline) != VK_SUCCESS) {
       throw std::runtime_error(
           "[VkPipeline]: My guts tell me that graphics pipeline creation "
           "failed delightfully. Goodluck debugging.");
@@ -169,8 +216,56 @@ struct Pipeline {
 
     /* For some reason shader modules are immediately deleted at the end of
      * pipeline creation */
-    vkDestroyShaderModule(device, fragShaderModule, nullptr);
-    vkDestroyShaderModule(device, vertShaderModule, nullptr);
+    vkDestroyShaderModule(device, fragShaderModule, HostMemory::callbacks());
+    vkDestroyShaderModule(device, vertShaderModule, HostMemory::callbacks());
+  }
+
+  /* A compute pipeline with one descriptor set and a push constant block. */
+  static void createCompute(const VkDevice &device,
+                            const VkPipelineCache &cache,
+                            const std::filesystem::path &shader,
+                            const VkDescriptorSetLayout &setLayout,
+                            uint32_t pushConstantSize,
+                            VkPipelineLayout &pipelineLayout,
+                            VkPipeline &computePipeline) {
+    auto code = readFile(shader);
+    VkShaderModule module = createShaderModule(code, device);
+
+    VkPushConstantRange pushConstant{};
+    pushConstant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstant.offset = 0;
+    pushConstant.size = pushConstantSize;
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &setLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = pushConstantSize > 0 ? 1 : 0;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstant;
+
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo,
+                               HostMemory::callbacks(),
+                               &pipelineLayout) != VK_SUCCESS) {
+      throw std::runtime_error(
+          "[VkPipeline]: I tried, okay? But I can't create pipeline at all.!");
+    }
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType =
+        VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = module;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = pipelineLayout;
+
+    if (vkCreateComputePipelines(device, cache, 1, &pipelineInfo,
+                                 HostMemory::callbacks(),
+                                 &computePipeline) != VK_SUCCESS) {
+      throw std::runtime_error(
+          "[VkPipeline]: The compute pipeline didn't compute.");
+    }
+    vkDestroyShaderModule(device, module, HostMemory::callbacks());
   }
 
   static VkShaderModule createShaderModule(const std::vector<char> &code,
@@ -181,8 +276,8 @@ struct Pipeline {
     createInfo.pCode = reinterpret_cast<const uint32_t *>(code.data());
 
     VkShaderModule shaderModule;
-    if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) !=
-        VK_SUCCESS) {
+    if (vkCreateShaderModule(device, &createInfo, HostMemory::callbacks(),
+                             &shaderModule) != VK_SUCCESS) {
       throw std::runtime_error("[VkPipeline]: Since I can't create shader "
                                "module, no graphics for you.");
     }
@@ -191,8 +286,8 @@ struct Pipeline {
 
   static void clean(const VkDevice &device, VkPipelineLayout &layout,
                     VkPipeline &graphicsPipeline) {
-    vkDestroyPipeline(device, graphicsPipeline, nullptr);
-    vkDestroyPipelineLayout(device, layout, nullptr);
+    vkDestroyPipeline(device, graphicsPipeline, HostMemory::callbacks());
+    vkDestroyPipelineLayout(device, layout, HostMemory::callbacks());
   }
 };
 
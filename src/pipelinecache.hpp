@@ -0,0 +1,138 @@
+#ifndef PIPELINECACHE_H_
+#define PIPELINECACHE_H_
+
+#include "hostmemory.hpp"
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+/**
+ * One VkPipelineCache for the whole run, seeded from disk and written back on
+ * the way out. The blob is only handed to the driver when its header says it
+ * was made by this very GPU and driver, anything else starts cold.
+ * */
+class PipelineCache {
+public:
+  void create(const VkDevice &device, const VkPhysicalDevice &physicalDevice,
+              const std::string &path) {
+    this->device = device;
+    this->path = path;
+
+    std::vector<char> blob;
+    if (!path.empty()) {
+      blob = load(physicalDevice);
+    }
+    warm = !blob.empty();
+
+    VkPipelineCacheCreateInfo cacheInfo{};
+    cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cacheInfo.initialDataSize = blob.size();
+    cacheInfo.pInitialData = blob.empty() ? nullptr : blob.data();
+    if (vkCreatePipelineCache(device, &cacheInfo, HostMemory::callbacks(),
+                              &cache) != VK_SUCCESS) {
+      throw std::runtime_error(
+          "[VkPipelineCache]: Can't even make an empty cache.");
+    }
+  }
+
+  /* Writes the blob next to the old one, then swaps it in. A crash halfway
+   * leaves the previous cache intact. */
+  void save() {
+    if (path.empty()) {
+      return;
+    }
+
+    size_t size = 0;
+    vkGetPipelineCacheData(device, cache, &size, nullptr);
+    std::vector<char> blob(size);
+    if (size == 0 ||
+        vkGetPipelineCacheData(device, cache, &size, blob.data()) !=
+            VK_SUCCESS) {
+      return;
+    }
+
+    std::string temporary = path + ".tmp";
+    {
+      std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+      file.write(blob.data(), static_cast<std::streamsize>(size));
+      if (!file) {
+        std::cerr << "[VkPipelineCache]: Couldn't write " << temporary
+                  << std::endl;
+        return;
+      }
+    }
+    std::error_code error;
+    std::filesystem::rename(temporary, path, error);
+    if (error) {
+      std::cerr << "[VkPipelineCache]: Couldn't replace " << path << ": "
+                << error.message() << std::endl;
+      std::filesystem::remove(temporary, error);
+    }
+  }
+
+  /* True when the driver was handed a blob it should be able to use. */
+  bool isWarm() const { return warm; }
+
+  const VkPipelineCache &get() const { return cache; }
+
+  void clean() {
+    save();
+    vkDestroyPipelineCache(device, cache, HostMemory::callbacks());
+  }
+
+private:
+  /* Reads the blob and checks that it belongs to this device and driver. */
+  std::vector<char> load(const VkPhysicalDevice &physicalDevice) {
+    std::ifstream file(path, std::ios::ate | std::ios::binary);
+    if (!file.is_open()) {
+      std::cout << "[VkPipelineCache]: Nothing at " << path
+                << ", starting cold." << std::endl;
+      return {};
+    }
+    std::vector<char> blob(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(blob.data(), static_cast<std::streamsize>(blob.size()));
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+    VkPipelineCacheHeaderVersionOne header{};
+    const char *reason = nullptr;
+    if (!file || blob.size() < sizeof(header)) {
+      reason = "it's too short";
+    } else {
+      memcpy(&header, blob.data(), sizeof(header));
+      if (header.headerSize < sizeof(header) ||
+          header.headerSize > blob.size() ||
+          header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE) {
+        reason = "the header is garbage";
+      } else if (header.vendorID != properties.vendorID ||
+                 header.deviceID != properties.deviceID) {
+        reason = "it's from another GPU";
+      } else if (memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID,
+                        VK_UUID_SIZE) != 0) {
+        reason = "it's from another driver";
+      }
+    }
+
+    if (reason != nullptr) {
+      std::cout << "[VkPipelineCache]: Ignoring " << path << ", " << reason
+                << "." << std::endl;
+      return {};
+    }
+    return blob;
+  }
+
+  VkDevice device = VK_NULL_HANDLE;
+  VkPipelineCache cache = VK_NULL_HANDLE;
+  std::string path;
+  bool warm = false;
+};
+
+#endif // PIPELINECACHE_H_
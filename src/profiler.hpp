@@ -0,0 +1,274 @@
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#include "hostmemory.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+/**
+ * GPU timestamps around interesting parts of a command buffer. Every slot
+ * owns a query pool; a slot is only read back when it is about to be reused,
+ * by which time its previous submission has retired, so reading never
+ * stalls. A recorded command buffer may be submitted many times, so reading
+ * back is keyed on submissions, not on recordings. Results end up in rolling
+ * per scope statistics and, optionally, in a Chrome trace (chrome://tracing
+ * or ui.perfetto.dev).
+ * */
+class Profiler {
+public:
+  static constexpr uint32_t MAX_SCOPES = 32;
+  static constexpr size_t WINDOW = 256;
+  static constexpr size_t MAX_TRACE_EVENTS = 100000;
+  static constexpr uint32_t UPLOAD_SLOT = UINT32_MAX;
+
+  /* Marks the span between construction and destruction. */
+  class Scope {
+  public:
+    Scope(Profiler &profiler, const VkCommandBuffer &commandBuffer,
+          const char *name)
+        : profiler(profiler), commandBuffer(commandBuffer),
+          query(profiler.open(commandBuffer, name, pool)) {}
+    ~Scope() { profiler.close(commandBuffer, pool, query); }
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+  private:
+    Profiler &profiler;
+    VkCommandBuffer commandBuffer;
+    VkQueryPool pool = VK_NULL_HANDLE;
+    int32_t query;
+  };
+
+  /* `slots` frame slots, more can be added with reserve(), plus one slot for
+   * uploads. */
+  void create(const VkDevice &device, const VkPhysicalDevice &physicalDevice,
+              uint32_t queueFamily, uint32_t slots) {
+    this->device = device;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount,
+                                             nullptr);
+    std::vector<VkQueueFamilyProperties> families(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount,
+                                             families.data());
+
+    validBits = families[queueFamily].timestampValidBits;
+    period = properties.limits.timestampPeriod;
+    if (validBits == 0 || period <= 0.0f) {
+      std::cout << "[VkProfiler]: This queue can't tell the time, profiling "
+                   "is off."
+                << std::endl;
+      return;
+    }
+    enabled = true;
+
+    createPool(upload);
+    reserve(slots);
+  }
+
+  /* Grows the number of frame slots to at least `count`. */
+  void reserve(uint32_t count) {
+    if (!enabled || count <= slots.size()) {
+      return;
+    }
+    current = nullptr;
+    slots.resize(count);
+    for (auto &slot : slots) {
+      if (slot.pool == VK_NULL_HANDLE) {
+        createPool(slot);
+      }
+    }
+  }
+
+  uint32_t frameSlots() const { return static_cast<uint32_t>(slots.size()); }
+
+  uint32_t uploadSlot() const { return UPLOAD_SLOT; }
+
+  /**
+   * Starts a new round of queries in `slot`. Must be recorded outside of a
+   * render pass, and only once the slot's previous submission has retired.
+   * */
+  void begin(const VkCommandBuffer &commandBuffer, uint32_t slot) {
+    if (!enabled) {
+      return;
+    }
+    collect(slot);
+    current = &at(slot);
+    current->names.clear();
+    vkCmdResetQueryPool(commandBuffer, current->pool, 0, MAX_SCOPES * 2);
+  }
+
+  /* The command buffer holding `slot`'s queries went to the GPU. */
+  void submitted(uint32_t slot) {
+    if (enabled) {
+      at(slot).pending = true;
+    }
+  }
+
+  /* Reads back what `slot` measured on its last submission, if it landed. */
+  void collect(uint32_t slot) {
+    if (!enabled || !at(slot).pending) {
+      return;
+    }
+    Slot &target = at(slot);
+    target.pending = false;
+    auto count = static_cast<uint32_t>(target.names.size()) * 2;
+
+    /* Value and availability for every query, no waiting. */
+    std::vector<uint64_t> results(count * 2);
+    vkGetQueryPoolResults(device, target.pool, 0, count,
+                          results.size() * sizeof(uint64_t), results.data(),
+                          2 * sizeof(uint64_t),
+                          VK_QUERY_RESULT_64_BIT |
+                              VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+    uint64_t mask = validBits >= 64 ? ~0ull : ((1ull << validBits) - 1);
+    for (size_t i = 0; i < target.names.size(); i++) {
+      uint64_t begin = results[4 * i] & mask;
+      uint64_t end = results[4 * i + 2] & mask;
+      if (results[4 * i + 1] == 0 || results[4 * i + 3] == 0 || end < begin) {
+        continue;
+      }
+      if (origin == 0) {
+        origin = begin;
+      }
+      double duration = (end - begin) * period / 1e6; // ms
+      auto &samples = stats[target.names[i]];
+      samples.push_back(duration);
+      if (samples.size() > WINDOW) {
+        samples.pop_front();
+      }
+      if (trace && events.size() < MAX_TRACE_EVENTS) {
+        double start = begin >= origin ? (begin - origin) * period / 1e3 : 0;
+        events.push_back({target.names[i], start, duration * 1e3});
+      }
+    }
+  }
+
+  /* Keeps every resolved scope around for writeTrace. */
+  void traceAll(bool trace) { this->trace = trace; }
+
+  /* Rolling min/avg/p99 over the last WINDOW samples of every scope. */
+  void report(std::ostream &out) const {
+    for (const auto &[name, samples] : stats) {
+      if (samples.empty()) {
+        continue;
+      }
+      std::vector<double> sorted(samples.begin(), samples.end());
+      std::sort(sorted.begin(), sorted.end());
+      double sum = 0.0;
+      for (double sample : sorted) {
+        sum += sample;
+      }
+      size_t p99 = std::min(sorted.size() - 1, sorted.size() * 99 / 100);
+      out << "[VkProfiler]: " << std::left << std::setw(12) << name
+          << std::fixed << std::setprecision(3) << " min " << sorted.front()
+          << " avg " << sum / sorted.size() << " p99 " << sorted[p99]
+          << " ms (" << sorted.size() << " samples)" << std::endl;
+    }
+  }
+
+  /* Chrome trace event format, one complete event per resolved scope. */
+  void writeTrace(const std::string &path) const {
+    std::ofstream file(path);
+    if (!file.is_open()) {
+      throw std::runtime_error("[VkProfiler]: Can't write the trace to " +
+                               path);
+    }
+    file << "{\"traceEvents\":[";
+    for (size_t i = 0; i < events.size(); i++) {
+      file << (i == 0 ? "" : ",") << "\n{\"name\":\"" << events[i].name
+           << "\",\"ph\":\"X\",\"pid\":0,\"tid\":0,\"ts\":" << std::fixed
+           << std::setprecision(3) << events[i].start
+           << ",\"dur\":" << events[i].duration << "}";
+    }
+    file << "\n],\"displayTimeUnit\":\"ms\"}" << std::endl;
+    std::cout << "[VkProfiler]: Wrote " << events.size() << " events to "
+              << path << std::endl;
+  }
+
+  void clean() {
+    for (auto &slot : slots) {
+      vkDestroyQueryPool(device, slot.pool, HostMemory::callbacks());
+    }
+    vkDestroyQueryPool(device, upload.pool, HostMemory::callbacks());
+    slots.clear();
+  }
+
+private:
+  struct Slot {
+    VkQueryPool pool = VK_NULL_HANDLE;
+    /* Scope names in the order their queries were handed out. */
+    std::vector<const char *> names;
+    /* Submitted and not read back yet. */
+    bool pending = false;
+  };
+
+  struct Event {
+    const char *name;
+    double start;    // us
+    double duration; // us
+  };
+
+  Slot &at(uint32_t slot) { return slot == UPLOAD_SLOT ? upload : slots[slot]; }
+
+  void createPool(Slot &slot) {
+    VkQueryPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    poolInfo.queryCount = MAX_SCOPES * 2;
+    if (vkCreateQueryPool(device, &poolInfo, HostMemory::callbacks(),
+                          &slot.pool) != VK_SUCCESS) {
+      throw std::runtime_error("[VkProfiler]: No query pool, no clock.");
+    }
+  }
+
+  int32_t open(const VkCommandBuffer &commandBuffer, const char *name,
+               VkQueryPool &pool) {
+    if (!enabled || current == nullptr ||
+        current->names.size() >= MAX_SCOPES) {
+      return -1;
+    }
+    auto query = static_cast<int32_t>(current->names.size());
+    current->names.push_back(name);
+    pool = current->pool;
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, pool,
+                        2 * query);
+    return query;
+  }
+
+  void close(const VkCommandBuffer &commandBuffer, const VkQueryPool &pool,
+             int32_t query) {
+    if (query < 0) {
+      return;
+    }
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                        pool, 2 * query + 1);
+  }
+
+  VkDevice device = VK_NULL_HANDLE;
+  bool enabled = false;
+  bool trace = false;
+  uint32_t validBits = 0;
+  float period = 0.0f; // ns per tick
+  uint64_t origin = 0;
+  std::vector<Slot> slots;
+  Slot upload;
+  Slot *current = nullptr;
+  std::map<std::string, std::deque<double>> stats;
+  std::vector<Event> events;
+};
+
+#endif // PROFILER_H_
@@ -0,0 +1,257 @@
+#ifndef QUANTIZE_H_
+#define QUANTIZE_H_
+
+#include "layout.hpp"
+#include "vertex.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+/**
+ * Float streams to the small integer and half formats of the compact vertex
+ * layouts, and back. The bulk kernels take plain contiguous arrays and use
+ * SSE2 (and F16C for halves) when the compiler targets them, falling back to
+ * the scalar versions otherwise. Results are the same either way: round to
+ * nearest, clamped to the target range, NaN at the bottom of it. Halves of
+ * NaN stay NaN, the payload may differ.
+ * */
+struct Quantize {
+  /* Scalar versions, also the reference the SIMD kernels must match. */
+  static int16_t snorm16(float value) {
+    /* NaN goes where maxps puts it, on the lower bound. */
+    float clamped = std::isnan(value) ? -1.0f : std::clamp(value, -1.0f, 1.0f);
+    return static_cast<int16_t>(std::lrint(clamped * 32767.0f));
+  }
+
+  static float fromSnorm16(int16_t value) {
+    return std::max(static_cast<float>(value) * (1.0f / 32767.0f), -1.0f);
+  }
+
+  static uint8_t unorm8(float value) {
+    float clamped = std::isnan(value) ? 0.0f : std::clamp(value, 0.0f, 1.0f);
+    return static_cast<uint8_t>(std::lrint(clamped * 255.0f));
+  }
+
+  static float fromUnorm8(uint8_t value) {
+    return static_cast<float>(value) * (1.0f / 255.0f);
+  }
+
+  static void snorm16(const float *in, int16_t *out, size_t count) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128 lo = _mm_set1_ps(-1.0f);
+    const __m128 hi = _mm_set1_ps(1.0f);
+    const __m128 scale = _mm_set1_ps(32767.0f);
+    for (; i + 8 <= count; i += 8) {
+      __m128 a = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + i), lo), hi);
+      __m128 b = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + i + 4), lo), hi);
+      /* cvtps rounds to nearest even, like lrint in the default mode. */
+      __m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(_mm_mul_ps(a, scale)),
+                                       _mm_cvtps_epi32(_mm_mul_ps(b, scale)));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), packed);
+    }
+#endif
+    for (; i < count; i++) {
+      out[i] = snorm16(in[i]);
+    }
+  }
+
+  static void fromSnorm16(const int16_t *in, float *out, size_t count) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128 lo = _mm_set1_ps(-1.0f);
+    const __m128 scale = _mm_set1_ps(1.0f / 32767.0f);
+    for (; i + 8 <= count; i += 8) {
+      __m128i values =
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+      /* Sign extend by unpacking into the high halves and shifting down. */
+      __m128i a = _mm_srai_epi32(_mm_unpacklo_epi16(values, values), 16);
+      __m128i b = _mm_srai_epi32(_mm_unpackhi_epi16(values, values), 16);
+      _mm_storeu_ps(out + i,
+                    _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(a), scale), lo));
+      _mm_storeu_ps(out + i + 4,
+                    _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(b), scale), lo));
+    }
+#endif
+    for (; i < count; i++) {
+      out[i] = fromSnorm16(in[i]);
+    }
+  }
+
+  static void unorm8(const float *in, uint8_t *out, size_t count) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128 lo = _mm_setzero_ps();
+    const __m128 hi = _mm_set1_ps(1.0f);
+    const __m128 scale = _mm_set1_ps(255.0f);
+    for (; i + 16 <= count; i += 16) {
+      __m128i words[2];
+      for (size_t half = 0; half < 2; half++) {
+        const float *at = in + i + half * 8;
+        __m128 a = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(at), lo), hi);
+        __m128 b = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(at + 4), lo), hi);
+        words[half] = _mm_packs_epi32(_mm_cvtps_epi32(_mm_mul_ps(a, scale)),
+                                      _mm_cvtps_epi32(_mm_mul_ps(b, scale)));
+      }
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i),
+                       _mm_packus_epi16(words[0], words[1]));
+    }
+#endif
+    for (; i < count; i++) {
+      out[i] = unorm8(in[i]);
+    }
+  }
+
+  static void fromUnorm8(const uint8_t *in, float *out, size_t count) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 scale = _mm_set1_ps(1.0f / 255.0f);
+    for (; i + 16 <= count; i += 16) {
+      __m128i bytes =
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+      __m128i words[2] = {_mm_unpacklo_epi8(bytes, zero),
+                          _mm_unpackhi_epi8(bytes, zero)};
+      for (size_t half = 0; half < 2; half++) {
+        __m128i a = _mm_unpacklo_epi16(words[half], zero);
+        __m128i b = _mm_unpackhi_epi16(words[half], zero);
+        float *at = out + i + half * 8;
+        _mm_storeu_ps(at, _mm_mul_ps(_mm_cvtepi32_ps(a), scale));
+        _mm_storeu_ps(at + 4, _mm_mul_ps(_mm_cvtepi32_ps(b), scale));
+      }
+    }
+#endif
+    for (; i < count; i++) {
+      out[i] = fromUnorm8(in[i]);
+    }
+  }
+
+  static void half(const float *in, uint16_t *out, size_t count) {
+    size_t i = 0;
+#if defined(__F16C__)
+    for (; i + 8 <= count; i += 8) {
+      __m128i packed = _mm256_cvtps_ph(_mm256_loadu_ps(in + i),
+                                       _MM_FROUND_TO_NEAREST_INT);
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), packed);
+    }
+#endif
+    for (; i < count; i++) {
+      out[i] = HalfFloat::pack(in[i]);
+    }
+  }
+
+  /**
+   * A unit normal folded onto the octahedron and flattened to a square, so
+   * two snorm16 hold it to within a few hundredths of a degree.
+   * */
+  static glm::vec2 octahedral(glm::vec3 normal) {
+    float sum = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+    glm::vec2 folded(normal.x / sum, normal.y / sum);
+    if (normal.z < 0.0f) {
+      /* The lower half goes to the corners. */
+      folded = glm::vec2((1.0f - std::abs(folded.y)) * sign(folded.x),
+                         (1.0f - std::abs(folded.x)) * sign(folded.y));
+    }
+    return folded;
+  }
+
+  static glm::vec3 fromOctahedral(glm::vec2 encoded) {
+    glm::vec3 normal(encoded.x, encoded.y,
+                     1.0f - std::abs(encoded.x) - std::abs(encoded.y));
+    float fold = std::max(-normal.z, 0.0f);
+    normal.x += normal.x >= 0.0f ? -fold : fold;
+    normal.y += normal.y >= 0.0f ? -fold : fold;
+    float length = std::sqrt(normal.x * normal.x + normal.y * normal.y +
+                             normal.z * normal.z);
+    return glm::vec3(normal.x / length, normal.y / length, normal.z / length);
+  }
+
+  /* Positions have to lie in [-1, 1], like everything Shape hands out. */
+  static std::vector<PackedVertex> pack(const std::vector<Vertex> &vertices) {
+    size_t count = vertices.size();
+    std::vector<float> positions(count * 2);
+    std::vector<float> colors(count * 4);
+    for (size_t i = 0; i < count; i++) {
+      positions[i * 2] = vertices[i].pos.x;
+      positions[i * 2 + 1] = vertices[i].pos.y;
+      colors[i * 4] = vertices[i].color.x;
+      colors[i * 4 + 1] = vertices[i].color.y;
+      colors[i * 4 + 2] = vertices[i].color.z;
+      colors[i * 4 + 3] = 1.0f;
+    }
+
+    std::vector<PackedVertex> packed(count);
+    std::vector<int16_t> quantizedPositions(count * 2);
+    std::vector<uint8_t> quantizedColors(count * 4);
+    snorm16(positions.data(), quantizedPositions.data(), positions.size());
+    unorm8(colors.data(), quantizedColors.data(), colors.size());
+    for (size_t i = 0; i < count; i++) {
+      packed[i].pos.value = {quantizedPositions[i * 2],
+                             quantizedPositions[i * 2 + 1]};
+      packed[i].color.value = {quantizedColors[i * 4],
+                               quantizedColors[i * 4 + 1],
+                               quantizedColors[i * 4 + 2],
+                               quantizedColors[i * 4 + 3]};
+    }
+    return packed;
+  }
+
+  /**
+   * Quantizes `count` synthetic vertices both ways and prints the footprint
+   * of each layout and how long the kernels took, SIMD against scalar.
+   * */
+  static void benchmark(std::ostream &out, size_t count) {
+    std::vector<float> positions(count * 2);
+    std::vector<float> colors(count * 4);
+    for (size_t i = 0; i < positions.size(); i++) {
+      positions[i] = std::sin(static_cast<float>(i));
+    }
+    for (size_t i = 0; i < colors.size(); i++) {
+      colors[i] = static_cast<float>(i % 256) / 255.0f;
+    }
+    std::vector<int16_t> quantizedPositions(positions.size());
+    std::vector<uint8_t> quantizedColors(colors.size());
+
+    auto simdStart = std::chrono::steady_clock::now();
+    snorm16(positions.data(), quantizedPositions.data(), positions.size());
+    unorm8(colors.data(), quantizedColors.data(), colors.size());
+    std::chrono::duration<double, std::milli> simd =
+        std::chrono::steady_clock::now() - simdStart;
+
+    auto scalarStart = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < positions.size(); i++) {
+      quantizedPositions[i] = snorm16(positions[i]);
+    }
+    for (size_t i = 0; i < colors.size(); i++) {
+      quantizedColors[i] = unorm8(colors[i]);
+    }
+    std::chrono::duration<double, std::milli> scalar =
+        std::chrono::steady_clock::now() - scalarStart;
+
+    out << "[VkQuantize]: " << count << " vertices, " << sizeof(Vertex)
+        << " -> " << sizeof(PackedVertex) << " bytes each ("
+        << count * sizeof(Vertex) / 1024 << " -> "
+        << count * sizeof(PackedVertex) / 1024 << " KiB). Quantized in "
+        << simd.count() << " ms"
+#if defined(__SSE2__)
+        << " with SSE2"
+#endif
+        << ", " << scalar.count() << " ms scalar." << std::endl;
+  }
+
+private:
+  static float sign(float value) { return value >= 0.0f ? 1.0f : -1.0f; }
+};
+
+#endif // QUANTIZE_H_
@@ -0,0 +1,97 @@
+#ifndef RECORDER_H_
+#define RECORDER_H_
+
+#include "commandpools.hpp"
+#include "commands.hpp"
+#include "workers.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+/**
+ * Splits a frame's draws across worker threads. Every worker job owns a
+ * command pool per swap chain image, so no two threads ever touch the same
+ * pool, and records its share into a secondary command buffer. The primary
+ * then only has to execute them in order. All of an image's buffers come
+ * from its own pools and are recycled together when it is recorded again.
+ * */
+class Recorder {
+public:
+  /* Below this many draws per thread, waking the workers costs more than
+   * recording everything inline. */
+  static constexpr size_t MIN_DRAWS_PER_JOB = 256;
+
+  void create(const VkDevice &device, uint32_t queueFamily, uint32_t threads,
+              uint32_t images) {
+    workers.create(threads);
+    /* The main thread gets a pool of its own next to the workers'. */
+    pools.create(device, queueFamily, threads + 1);
+    resize(images);
+  }
+
+  /* One set of pools per swap chain image. */
+  void resize(uint32_t images) {
+    pools.resize(images);
+    used.resize(images);
+  }
+
+  /* Recycles everything `image` recorded last time in one go and hands out
+   * a fresh primary for it. The image's previous submission must have
+   * retired. */
+  VkCommandBuffer begin(uint32_t image) {
+    pools.reset(image);
+    return pools.allocate(image, MAIN_THREAD, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+  }
+
+  /**
+   * Records the `scene` for `image` across the workers, splitting its sorted
+   * queue. Returns the secondaries to execute, or nothing when the frame is
+   * too small to be worth it and should be recorded inline. Call after
+   * begin().
+   * */
+  const std::vector<VkCommandBuffer> &
+  record(uint32_t image, const VkRenderPass &renderPass,
+         const VkFramebuffer &framebuffer, const VkExtent2D &extent,
+         const Scene &scene) {
+    const RenderQueue &queue = scene.queue;
+    std::vector<VkCommandBuffer> &secondaries = used[image];
+    secondaries.clear();
+
+    size_t jobs = std::min<size_t>(workers.size(),
+                                   queue.size() / MIN_DRAWS_PER_JOB);
+    if (jobs <= 1) {
+      return secondaries;
+    }
+
+    /* A job runs on one thread at a time, so job n owns pool n + 1. Jobs
+     * take contiguous runs of the sorted queue, so state stays grouped. */
+    secondaries.resize(jobs);
+    size_t perJob = (queue.size() + jobs - 1) / jobs;
+    workers.run(static_cast<uint32_t>(jobs), [&](uint32_t job) {
+      size_t first = job * perJob;
+      size_t count = std::min(perJob, queue.size() - first);
+      secondaries[job] = pools.allocate(image, job + 1,
+                                        VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+      Commands::recordSecondary(secondaries[job], renderPass, framebuffer,
+                                extent, scene, first, count);
+    });
+    return secondaries;
+  }
+
+  void clean() {
+    workers.clean();
+    pools.clean();
+    used.clear();
+  }
+
+private:
+  static constexpr uint32_t MAIN_THREAD = 0;
+
+  WorkerPool workers;
+  CommandPools pools;
+  /* The secondaries the last recording of each image produced. */
+  std::vector<std::vector<VkCommandBuffer>> used;
+};
+
+#endif // RECORDER_H_
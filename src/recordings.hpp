@@ -0,0 +1,67 @@
+#ifndef RECORDINGS_H_
+#define RECORDINGS_H_
+
+#include <cstdint>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+/**
+ * One command buffer per swap chain image, recorded once and replayed every
+ * time that image comes around again. The scene carries a version; anything
+ * that changes what Commands::record would produce bumps it through
+ * invalidate(), and a buffer is only re-recorded when its version is behind.
+ * */
+class Recordings {
+public:
+  void create(uint32_t count) { resize(count); }
+
+  /* Follows the swap chain image count, everything gets recorded again. */
+  void resize(uint32_t count) {
+    if (slots.size() < count) {
+      slots.resize(count);
+    }
+    invalidate();
+  }
+
+  /* Something Commands::record depends on changed. */
+  void invalidate() { version++; }
+
+  /* Only what `image` draws changed, the others still replay. */
+  void invalidate(uint32_t image) { slots[image].version = 0; }
+
+  bool stale(uint32_t image) const { return slots[image].version != version; }
+
+  /* The caller re-recorded `image` into `commandBuffer`. */
+  void recorded(uint32_t image, const VkCommandBuffer &commandBuffer) {
+    slots[image].commandBuffer = commandBuffer;
+    slots[image].version = version;
+    recordCount++;
+  }
+
+  /* Timeline value of the last submission of `image`. Re-recording has to
+   * wait for it, the buffer may outlive the swap chain it was recorded for. */
+  uint64_t &lastUse(uint32_t image) { return slots[image].lastUse; }
+
+  const VkCommandBuffer &get(uint32_t image) const {
+    return slots[image].commandBuffer;
+  }
+
+  uint64_t recordings() const { return recordCount; }
+
+  /* The command buffers belong to the Recorder's pools. */
+  void clean() { slots.clear(); }
+
+private:
+  struct Slot {
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    /* Zero never matches, so a fresh buffer is always recorded first. */
+    uint64_t version = 0;
+    uint64_t lastUse = 0;
+  };
+
+  std::vector<Slot> slots;
+  uint64_t version = 0;
+  uint64_t recordCount = 0;
+};
+
+#endif // RECORDINGS_H_
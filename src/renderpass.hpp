@@ -1,12 +1,14 @@
 #ifndef RENDERPASS_H_
 #define RENDERPASS_H_
 
+#include "hostmemory.hpp"
 #include <vulkan/vulkan_core.h>
 struct RenderPass {
 
   static void create(const VkDevice &device,
                      const VkFormat &swapChainImageFormat,
-                     VkRenderPass &renderPass) {
+                     VkRenderPass &renderPass,
+                     VkImageLayout finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR) {
     VkAttachmentDescription colorAttachment{};
     colorAttachment.format = swapChainImageFormat;
     colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
@@ -15,7 +17,7 @@ struct RenderPass {
     colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    colorAttachment.finalLayout = finalLayout;
 
     VkAttachmentReference colorAttachmentRef{};
     colorAttachmentRef.attachment = 0;
@@ -43,8 +45,8 @@ struct RenderPass {
     renderPassInfo.dependencyCount = 1;
     renderPassInfo.pDependencies = &dependency;
 
-    if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) !=
-        VK_SUCCESS) {
+    if (vkCreateRenderPass(device, &renderPassInfo, HostMemory::callbacks(),
+                           &renderPass) != VK_SUCCESS) {
       throw std::runtime_error(
           "[VkRenderPass]: How are you going to render without render pass. "
           "That thing failed to initialize!");
@@ -52,7 +54,7 @@ struct RenderPass {
   }
 
   static void clean(const VkDevice &device, const VkRenderPass &renderPass) {
-    vkDestroyRenderPass(device, renderPass, nullptr);
+    vkDestroyRenderPass(device, renderPass, HostMemory::callbacks());
   }
 };
 
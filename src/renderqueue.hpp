@@ -0,0 +1,196 @@
+#ifndef RENDERQUEUE_H_
+#define RENDERQUEUE_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+/* Everything one indexed draw needs, bound from scratch. */
+struct DrawPacket {
+  /* Coarse ordering first, e.g. opaque before transparent. */
+  uint8_t layer = 0;
+  VkPipeline pipeline = VK_NULL_HANDLE;
+  VkBuffer vertexBuffer = VK_NULL_HANDLE;
+  VkDeviceSize vertexBufferOffset = 0;
+  VkBuffer indexBuffer = VK_NULL_HANDLE;
+  VkDeviceSize indexBufferOffset = 0;
+  VkIndexType indexType = VK_INDEX_TYPE_UINT16;
+  uint32_t indexCount = 0;
+  uint32_t firstIndex = 0;
+  int32_t vertexOffset = 0;
+  uint32_t instanceCount = 1;
+  uint32_t firstInstance = 0;
+};
+
+/**
+ * Only binds what actually changes. One per command buffer being recorded,
+ * a fresh command buffer has nothing bound.
+ * */
+struct StateTracker {
+  VkPipeline pipeline = VK_NULL_HANDLE;
+  VkBuffer vertexBuffer = VK_NULL_HANDLE;
+  VkDeviceSize vertexBufferOffset = 0;
+  VkBuffer indexBuffer = VK_NULL_HANDLE;
+  VkDeviceSize indexBufferOffset = 0;
+  VkIndexType indexType = VK_INDEX_TYPE_UINT16;
+  uint32_t binds = 0;
+
+  void bind(const VkCommandBuffer &commandBuffer, const DrawPacket &packet) {
+    if (packet.pipeline != pipeline) {
+      vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                        packet.pipeline);
+      pipeline = packet.pipeline;
+      binds++;
+    }
+    if (packet.vertexBuffer != vertexBuffer ||
+        packet.vertexBufferOffset != vertexBufferOffset) {
+      vkCmdBindVertexBuffers(commandBuffer, 0, 1, &packet.vertexBuffer,
+                             &packet.vertexBufferOffset);
+      vertexBuffer = packet.vertexBuffer;
+      vertexBufferOffset = packet.vertexBufferOffset;
+      binds++;
+    }
+    if (packet.indexBuffer != indexBuffer ||
+        packet.indexBufferOffset != indexBufferOffset ||
+        packet.indexType != indexType) {
+      vkCmdBindIndexBuffer(commandBuffer, packet.indexBuffer,
+                           packet.indexBufferOffset, packet.indexType);
+      indexBuffer = packet.indexBuffer;
+      indexBufferOffset = packet.indexBufferOffset;
+      indexType = packet.indexType;
+      binds++;
+    }
+  }
+};
+
+/**
+ * Collects draw packets, orders them by a 64-bit key built from their state
+ * and emits them so that equal state ends up next to each other. Key layout,
+ * most significant first:
+ *
+ *   layer:8 | pipeline:16 | vertex buffer:16 | index buffer:16 | unused:8
+ *
+ * Handles are replaced by small ids handed out in first seen order, so the
+ * key of a handle never changes while the queue lives.
+ * */
+class RenderQueue {
+public:
+  void submit(const DrawPacket &packet) { packets.push_back(packet); }
+
+  void clear() {
+    packets.clear();
+    sorted.clear();
+  }
+
+  /* LSD radix sort over the keys, 8 bits a pass. Stable, so packets with
+   * equal state keep their submission order. */
+  void sort() {
+    sorted.resize(packets.size());
+    for (size_t i = 0; i < packets.size(); i++) {
+      sorted[i] = {key(packets[i]), static_cast<uint32_t>(i)};
+    }
+    scratch.resize(sorted.size());
+
+    for (uint32_t shift = 0; shift < 64; shift += 8) {
+      std::array<size_t, 256> counts{};
+      for (const auto &entry : sorted) {
+        counts[(entry.key >> shift) & 0xff]++;
+      }
+      /* Every key has the same byte here, the pass wouldn't move anything. */
+      if (counts[(sorted.empty() ? 0 : sorted[0].key >> shift) & 0xff] ==
+          sorted.size()) {
+        continue;
+      }
+      size_t offset = 0;
+      for (auto &count : counts) {
+        size_t bucket = count;
+        count = offset;
+        offset += bucket;
+      }
+      for (const auto &entry : sorted) {
+        scratch[counts[(entry.key >> shift) & 0xff]++] = entry;
+      }
+      sorted.swap(scratch);
+    }
+
+    stateChanges = 0;
+    StateTracker tracker;
+    for (const auto &entry : sorted) {
+      const DrawPacket &packet = packets[entry.index];
+      stateChanges += (packet.pipeline != tracker.pipeline) +
+                      (packet.vertexBuffer != tracker.vertexBuffer) +
+                      (packet.indexBuffer != tracker.indexBuffer);
+      tracker.pipeline = packet.pipeline;
+      tracker.vertexBuffer = packet.vertexBuffer;
+      tracker.indexBuffer = packet.indexBuffer;
+    }
+  }
+
+  /* Sorted packets [first, first + count) into `commandBuffer`. */
+  void record(const VkCommandBuffer &commandBuffer, size_t first,
+              size_t count) const {
+    StateTracker tracker;
+    for (size_t i = first; i < first + count; i++) {
+      const DrawPacket &packet = packets[sorted[i].index];
+      tracker.bind(commandBuffer, packet);
+      vkCmdDrawIndexed(commandBuffer, packet.indexCount, packet.instanceCount,
+                       packet.firstIndex, packet.vertexOffset,
+                       packet.firstInstance);
+    }
+  }
+
+  size_t size() const { return sorted.size(); }
+
+  void report(std::ostream &out) const {
+    out << "[VkRenderQueue]: " << sorted.size() << " draws, " << stateChanges
+        << " state changes." << std::endl;
+  }
+
+private:
+  struct Entry {
+    uint64_t key;
+    uint32_t index;
+  };
+
+  using Ids = std::unordered_map<uint64_t, uint16_t>;
+
+  uint64_t key(const DrawPacket &packet) {
+    return static_cast<uint64_t>(packet.layer) << 56 |
+           static_cast<uint64_t>(id(pipelines, packet.pipeline)) << 40 |
+           static_cast<uint64_t>(id(vertexBuffers, packet.vertexBuffer)) << 24 |
+           static_cast<uint64_t>(id(indexBuffers, packet.indexBuffer)) << 8;
+  }
+
+  /* Vulkan handles are pointers or integers depending on the platform. */
+  template <typename Handle> static uint16_t id(Ids &ids, Handle handle) {
+    uint64_t raw = 0;
+    memcpy(&raw, &handle, sizeof(handle));
+    auto found = ids.find(raw);
+    if (found != ids.end()) {
+      return found->second;
+    }
+    if (ids.size() > UINT16_MAX) {
+      throw std::runtime_error(
+          "[VkRenderQueue]: More than 65536 of one thing. Sort keys are full.");
+    }
+    auto next = static_cast<uint16_t>(ids.size());
+    ids.emplace(raw, next);
+    return next;
+  }
+
+  std::vector<DrawPacket> packets;
+  std::vector<Entry> sorted;
+  std::vector<Entry> scratch;
+  Ids pipelines;
+  Ids vertexBuffers;
+  Ids indexBuffers;
+  size_t stateChanges = 0;
+};
+
+#endif // RENDERQUEUE_H_
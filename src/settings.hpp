@@ -5,12 +5,24 @@
 #include <cstdint>
 #include <cstring>
 #include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
 #include <vector>
 #include <vulkan/vulkan.h>
 #include <vulkan/vulkan_core.h>
 
 static const uint32_t WIDTH = 800;
 static const uint32_t HEIGHT = 600;
+/* How many frames the CPU may record ahead of the GPU. */
+static const uint32_t MAX_FRAMES_IN_FLIGHT = 2;
+/* Headless runs have no close button, so they stop after this many frames. */
+static const uint64_t HEADLESS_FRAMES = 1000;
+/* Size of the synthetic mesh --quantize-benchmark times the kernels on. */
+static const size_t QUANTIZE_BENCHMARK_VERTICES = 1 << 20;
+/* What the geometry pool holds, shared by every mesh. */
+static const VkDeviceSize GEOMETRY_VERTEX_BYTES = 16ull << 20;
+static const uint32_t GEOMETRY_INDICES = 1 << 20;
 static const std::vector<const char *> validationLayers = {
     "VK_LAYER_KHRONOS_validation"};
 
@@ -49,14 +61,17 @@ struct Validation {
 
 struct Extensions {
   // Bundles the always required GLFW extensions along with the validations
-  static std::vector<const char *> get() {
-    uint32_t glfwExtensionCount = 0;
-    const char **glfwExtensions;
-    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-    // Why do we add the final pointer?
-    // TODO: Verify the meaning of this.
-    std::vector<const char *> extensions(glfwExtensions,
-                                         glfwExtensions + glfwExtensionCount);
+  static std::vector<const char *> get(bool headless = false) {
+    std::vector<const char *> extensions;
+    /* Without a window there is no surface, hence no surface extensions. */
+    if (!headless) {
+      uint32_t glfwExtensionCount = 0;
+      const char **glfwExtensions;
+      glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+      // Why do we add the final pointer?
+      // TODO: Verify the meaning of this.
+      extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    }
     if (enableValidationLayers) {
       extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
     }
@@ -64,4 +79,85 @@ struct Extensions {
   }
 };
 
+// Knobs that can be changed from the command line without a rebuild.
+struct Options {
+  uint32_t framesInFlight = MAX_FRAMES_IN_FLIGHT;
+  /* Render into offscreen images, without GLFW, a surface or a swap chain. */
+  bool headless = false;
+  /* Stop after this many frames, zero runs until the window is closed. */
+  uint64_t frameLimit = 0;
+  /* Where to write the GPU timeline as a Chrome trace, empty for nowhere. */
+  std::string tracePath;
+  /* Compiled pipelines survive between runs here, empty to always compile. */
+  std::string pipelineCachePath = "pipeline.cache";
+  /* Threads recording draws, zero records everything on the main thread. */
+  uint32_t threads = std::thread::hardware_concurrency();
+  /* Draw the scene this many times over, to load up the CPU side. */
+  uint32_t draws = 1;
+  /* Let a compute pass build the draws on the GPU instead of the queue. */
+  bool indirect = false;
+  /* Draw this many copies of the shape in one instanced call, zero for none. */
+  uint32_t instances = 0;
+  /* Quads the sprite batcher writes every frame, zero for none. */
+  uint32_t sprites = 0;
+  /* Draw the scene from quantized PackedVertex data instead of floats. */
+  bool compact = false;
+  /* Time the quantization kernels on a synthetic mesh at startup. */
+  bool quantizeBenchmark = false;
+  /* Hand the driver's host allocations to HostMemory and report on them. */
+  bool hostAllocator = false;
+
+  static Options parse(int argc, char **argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+      std::string arg = argv[i];
+      if (arg == "--frames-in-flight" && i + 1 < argc) {
+        options.framesInFlight =
+            static_cast<uint32_t>(std::stoul(std::string(argv[++i])));
+      } else if (arg == "--headless") {
+        options.headless = true;
+      } else if (arg == "--frames" && i + 1 < argc) {
+        options.frameLimit = std::stoull(std::string(argv[++i]));
+      } else if (arg == "--trace" && i + 1 < argc) {
+        options.tracePath = argv[++i];
+      } else if (arg == "--pipeline-cache" && i + 1 < argc) {
+        options.pipelineCachePath = argv[++i];
+      } else if (arg == "--no-pipeline-cache") {
+        options.pipelineCachePath.clear();
+      } else if (arg == "--threads" && i + 1 < argc) {
+        options.threads =
+            static_cast<uint32_t>(std::stoul(std::string(argv[++i])));
+      } else if (arg == "--draws" && i + 1 < argc) {
+        options.draws =
+            static_cast<uint32_t>(std::stoul(std::string(argv[++i])));
+      } else if (arg == "--instances" && i + 1 < argc) {
+        options.instances =
+            static_cast<uint32_t>(std::stoul(std::string(argv[++i])));
+      } else if (arg == "--sprites" && i + 1 < argc) {
+        options.sprites =
+            static_cast<uint32_t>(std::stoul(std::string(argv[++i])));
+      } else if (arg == "--compact") {
+        options.compact = true;
+      } else if (arg == "--quantize-benchmark") {
+        options.quantizeBenchmark = true;
+      } else if (arg == "--indirect") {
+        options.indirect = true;
+      } else if (arg == "--host-allocator") {
+        options.hostAllocator = true;
+      } else {
+        throw std::runtime_error("[VkOptions]: What am I supposed to do with " +
+                                 arg + "?");
+      }
+    }
+    if (options.framesInFlight == 0) {
+      throw std::runtime_error(
+          "[VkOptions]: Zero frames in flight means nothing ever flies.");
+    }
+    if (options.headless && options.frameLimit == 0) {
+      options.frameLimit = HEADLESS_FRAMES;
+    }
+    return options;
+  }
+};
+
 #endif // SETTINGS_H_
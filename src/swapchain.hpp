@@ -1,5 +1,6 @@
 #ifndef SWAPCHAIN_H_
 #define SWAPCHAIN_H_
+#include "hostmemory.hpp"
 #include "vulkan/vulkan.hpp"
 #include <GLFW/glfw3.h>
 #include <algorithm>
@@ -15,9 +16,14 @@
 struct QueueFamilyIndices {
   std::optional<uint32_t> graphicsFamily;
   std::optional<uint32_t> presentFamily;
-
-  bool isComplete() {
-    return graphicsFamily.has_value() && presentFamily.has_value();
+  /* Copy engine and async compute, only set when they don't do graphics. */
+  std::optional<uint32_t> transferFamily;
+  std::optional<uint32_t> computeFamily;
+
+  /* Headless devices never present, so they only need graphics. */
+  bool isComplete(bool present = true) {
+    return graphicsFamily.has_value() &&
+           (!present || presentFamily.has_value());
   }
 
   static QueueFamilyIndices find(const VkPhysicalDevice &device,
@@ -36,13 +42,20 @@ struct QueueFamilyIndices {
     for (const auto &queueFamily : queueFamilies) {
       if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
         indices.graphicsFamily = i;
+      } else if (queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT) {
+        indices.computeFamily = i;
+      } else if (queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT) {
+        indices.transferFamily = i;
       }
       /* Check for the presentation support */
-      VkBool32 presentSupport = false;
-      vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
-
-      if (presentSupport) {
-        indices.presentFamily = i;
+      if (surface != VK_NULL_HANDLE) {
+        VkBool32 presentSupport = false;
+        vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface,
+                                             &presentSupport);
+
+        if (presentSupport) {
+          indices.presentFamily = i;
+        }
       }
       i++;
     }
@@ -138,7 +151,8 @@ public:
                      const VkSurfaceKHR &surface, const VkDevice &device,
                      VkSwapchainKHR *swapChain,
                      std::vector<VkImage> &swapChainImages,
-                     VkFormat &imageFormat, VkExtent2D &swapExtent) {
+                     VkFormat &imageFormat, VkExtent2D &swapExtent,
+                     VkSwapchainKHR oldSwapChain = VK_NULL_HANDLE) {
     SwapChain swapchain = SwapChain::query(physicalDevice, surface);
     auto surfaceFormat = SwapChain::chooseSwapSurfaceFormat(swapchain.formats);
     auto presentMode = SwapChain::chooseSwapPresentMode(swapchain.presentModes);
@@ -182,9 +196,10 @@ public:
     createInfo.presentMode = presentMode;
     createInfo.clipped = VK_TRUE;
 
-    createInfo.oldSwapchain = VK_NULL_HANDLE;
-    if (vkCreateSwapchainKHR(device, &createInfo, nullptr, swapChain) !=
-        VK_SUCCESS) {
+    /* Lets the driver hand resources over from the chain being replaced. */
+    createInfo.oldSwapchain = oldSwapChain;
+    if (vkCreateSwapchainKHR(device, &createInfo, HostMemory::callbacks(),
+                             swapChain) != VK_SUCCESS) {
       throw std::runtime_error("[VkSwapChain]: No swap chain created.");
     }
 
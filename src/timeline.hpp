@@ -0,0 +1,158 @@
+#ifndef TIMELINE_H_
+#define TIMELINE_H_
+
+#include "hostmemory.hpp"
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <vulkan/vulkan_core.h>
+
+/**
+ * Collects what goes into a single vkQueueSubmit. Binary semaphores simply
+ * use a value of zero, the driver ignores it for them. Capacity is fixed so
+ * building a submission every frame never touches the heap.
+ * */
+struct Submit {
+  static constexpr uint32_t MAX_ENTRIES = 4;
+
+  std::array<VkSemaphore, MAX_ENTRIES> waitSemaphores{};
+  std::array<uint64_t, MAX_ENTRIES> waitValues{};
+  std::array<VkPipelineStageFlags, MAX_ENTRIES> waitStages{};
+  uint32_t waitCount = 0;
+
+  std::array<VkSemaphore, MAX_ENTRIES> signalSemaphores{};
+  std::array<uint64_t, MAX_ENTRIES> signalValues{};
+  uint32_t signalCount = 0;
+
+  std::array<VkCommandBuffer, MAX_ENTRIES> commandBuffers{};
+  uint32_t commandCount = 0;
+
+  void wait(const VkSemaphore &semaphore, VkPipelineStageFlags stage,
+            uint64_t value = 0) {
+    check(waitCount);
+    waitSemaphores[waitCount] = semaphore;
+    waitStages[waitCount] = stage;
+    waitValues[waitCount] = value;
+    waitCount++;
+  }
+
+  void signal(const VkSemaphore &semaphore, uint64_t value = 0) {
+    check(signalCount);
+    signalSemaphores[signalCount] = semaphore;
+    signalValues[signalCount] = value;
+    signalCount++;
+  }
+
+  void commands(const VkCommandBuffer &commandBuffer) {
+    check(commandCount);
+    commandBuffers[commandCount++] = commandBuffer;
+  }
+
+  VkResult to(const VkQueue &queue) const {
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount = waitCount;
+    timelineInfo.pWaitSemaphoreValues = waitValues.data();
+    timelineInfo.signalSemaphoreValueCount = signalCount;
+    timelineInfo.pSignalSemaphoreValues = signalValues.data();
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.waitSemaphoreCount = waitCount;
+    submitInfo.pWaitSemaphores = waitSemaphores.data();
+    submitInfo.pWaitDstStageMask = waitStages.data();
+    submitInfo.commandBufferCount = commandCount;
+    submitInfo.pCommandBuffers = commandBuffers.data();
+    submitInfo.signalSemaphoreCount = signalCount;
+    submitInfo.pSignalSemaphores = signalSemaphores.data();
+
+    return vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
+  }
+
+private:
+  static void check(uint32_t count) {
+    if (count >= MAX_ENTRIES) {
+      throw std::runtime_error("[VkSubmit]: Too much stuff in one submit.");
+    }
+  }
+};
+
+/**
+ * A timeline semaphore and the last value handed out on it. Every submission
+ * to a queue signals the next value, so "is this work done?" becomes a
+ * comparison of two integers instead of a fence reset/wait round trip.
+ * */
+class Timeline {
+public:
+  void create(const VkDevice &device) {
+    this->device = device;
+
+    VkSemaphoreTypeCreateInfo typeInfo{};
+    typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    typeInfo.initialValue = 0;
+
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreInfo.pNext = &typeInfo;
+
+    if (vkCreateSemaphore(device, &semaphoreInfo, HostMemory::callbacks(),
+                          &semaphore) != VK_SUCCESS) {
+      throw std::runtime_error(
+          "[VkTimeline]: No timeline, no idea what time it is.");
+    }
+  }
+
+  /* Adds the next timeline value to the submission and sends it off. */
+  uint64_t submit(const VkQueue &queue, Submit &submit) {
+    submit.signal(semaphore, pending + 1);
+    if (submit.to(queue) != VK_SUCCESS) {
+      throw std::runtime_error(
+          "[VkTimeline]: You half baked commands doesn't make me tick. Fix it.");
+    }
+    return ++pending;
+  }
+
+  /* True once the GPU has signaled `value`, without blocking. */
+  bool reached(uint64_t value) {
+    if (value <= completed) {
+      return true;
+    }
+    vkGetSemaphoreCounterValue(device, semaphore, &completed);
+    return value <= completed;
+  }
+
+  /* Blocks until the GPU has signaled `value`. */
+  void wait(uint64_t value) {
+    if (reached(value)) {
+      return;
+    }
+    VkSemaphoreWaitInfo waitInfo{};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &semaphore;
+    waitInfo.pValues = &value;
+    if (vkWaitSemaphores(device, &waitInfo, UINT64_MAX) != VK_SUCCESS) {
+      throw std::runtime_error("[VkTimeline]: Waited forever, got nothing.");
+    }
+    completed = value;
+  }
+
+  /* Last value handed to a submission. */
+  uint64_t last() const { return pending; }
+
+  const VkSemaphore &get() const { return semaphore; }
+
+  void clean() {
+    vkDestroySemaphore(device, semaphore, HostMemory::callbacks());
+  }
+
+private:
+  VkDevice device = VK_NULL_HANDLE;
+  VkSemaphore semaphore = VK_NULL_HANDLE;
+  uint64_t pending = 0;
+  uint64_t completed = 0;
+};
+
+#endif // TIMELINE_H_
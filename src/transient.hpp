@@ -0,0 +1,140 @@
+#ifndef TRANSIENT_H_
+#define TRANSIENT_H_
+
+#include "allocator.hpp"
+#include "buffers.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+/* A piece of this frame's transient memory, written through `mapped`. */
+struct Transient {
+  VkBuffer buffer = VK_NULL_HANDLE;
+  VkDeviceSize offset = 0;
+  void *mapped = nullptr;
+};
+
+/**
+ * Bump allocator for data that lives one frame: per frame vertices, indices,
+ * instances and uniforms. Every swap chain image gets a persistently mapped
+ * buffer of `capacity` bytes, rewound by begin() once the image's last
+ * submission retired, so an allocation is a pointer bump and nothing is
+ * ever freed on its own.
+ *
+ * A frame that wants more than `capacity` spills into another buffer of the
+ * image, made the first time it is needed and kept from then on, so the
+ * estimate only has to be good, not exact.
+ *
+ * Recordings are replayed per image, so a frame that allocates the same
+ * sizes in the same order gets the same buffers and offsets as the last
+ * time, and its recording stays valid.
+ * */
+class TransientBuffers {
+public:
+  /* Satisfies every offset alignment the spec allows a device to ask for. */
+  static constexpr VkDeviceSize ALIGNMENT = 256;
+
+  static constexpr VkBufferUsageFlags USAGE =
+      VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+      VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+
+  /* What `size` bytes take out of a frame, for sizing `capacity`. */
+  static constexpr VkDeviceSize aligned(VkDeviceSize size) {
+    return (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+  }
+
+  void create(const VkDevice &device, Allocator &allocator,
+              VkDeviceSize capacity, uint32_t slots) {
+    this->device = device;
+    this->allocator = &allocator;
+    this->capacity = aligned(capacity);
+    resize(slots);
+  }
+
+  /* Follows the swap chain image count. Existing buffers are kept. */
+  void resize(uint32_t slots) {
+    while (capacity > 0 && buffers.size() < slots) {
+      buffers.emplace_back();
+      buffers.back().push_back(createPage(capacity));
+    }
+  }
+
+  /* Starts the frame of `slot`, whose last submission must have retired. */
+  void begin(uint32_t slot) {
+    current = slot;
+    page = 0;
+    head = 0;
+    used = 0;
+  }
+
+  Transient allocate(VkDeviceSize size) {
+    std::vector<Page> &pages = buffers[current];
+    while (page < pages.size() && head + size > pages[page].size) {
+      page++;
+      head = 0;
+    }
+    if (page == pages.size()) {
+      pages.push_back(createPage(std::max(capacity, aligned(size))));
+      spills++;
+    }
+    Page &target = pages[page];
+    Transient piece{target.buffer, head,
+                    static_cast<char *>(target.memory.mapped) + head};
+    head += aligned(size);
+    used += aligned(size);
+    peak = std::max(peak, used);
+    return piece;
+  }
+
+  void report(std::ostream &out) const {
+    if (buffers.empty()) {
+      return;
+    }
+    out << "[VkTransient]: " << (peak >> 10) << " of " << (capacity >> 10)
+        << " KiB per frame used at most, " << buffers.size() << " frames, "
+        << spills << " extra buffers for frames that wanted more."
+        << std::endl;
+  }
+
+  void clean() {
+    for (auto &pages : buffers) {
+      for (auto &page : pages) {
+        Buffers::clean(device, page.buffer);
+        allocator->free(page.memory);
+      }
+    }
+    buffers.clear();
+  }
+
+private:
+  struct Page {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    Memory memory;
+    VkDeviceSize size = 0;
+  };
+
+  Page createPage(VkDeviceSize size) {
+    Page page;
+    page.size = size;
+    Buffers::create(device, page.buffer, static_cast<uint32_t>(size), USAGE);
+    page.memory = allocator->allocate(page.buffer, Buffers::STREAMING);
+    return page;
+  }
+
+  VkDevice device = VK_NULL_HANDLE;
+  Allocator *allocator = nullptr;
+  VkDeviceSize capacity = 0;
+  /* Per swap chain image, the first page is `capacity` bytes. */
+  std::vector<std::vector<Page>> buffers;
+
+  uint32_t current = 0;
+  size_t page = 0;
+  VkDeviceSize head = 0;
+  VkDeviceSize used = 0;
+  VkDeviceSize peak = 0;
+  uint32_t spills = 0;
+};
+
+#endif // TRANSIENT_H_
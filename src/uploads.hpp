@@ -0,0 +1,375 @@
+#ifndef UPLOADS_H_
+#define UPLOADS_H_
+
+#include "allocator.hpp"
+#include "hostmemory.hpp"
+#include "profiler.hpp"
+#include "timeline.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+/* Redeemable for "the data is on the GPU". The default one already is. */
+struct Ticket {
+  uint64_t batch = 0;
+};
+
+/**
+ * Streams data into device local buffers through one persistently mapped
+ * staging ring. Uploads are only queued up; flush() records every pending
+ * copy into a single command buffer (one vkCmdCopyBuffer per destination,
+ * many regions each) and submits it once. Nobody waits unless they ask to,
+ * and ring space comes back as soon as the timeline says the copy is done.
+ *
+ * With a dedicated transfer family the copies run on the copy engine next to
+ * rendering. The regions are then released to the graphics family there and
+ * acquired by a small barrier-only submit on the graphics queue, which waits
+ * on the transfer timeline. A destination must not be read by graphics while
+ * it is being streamed to.
+ * */
+class Uploader {
+public:
+  static constexpr VkDeviceSize RING_SIZE = 16ull << 20;
+  static constexpr VkDeviceSize ALIGNMENT = 16;
+  /* Bigger uploads are streamed through the ring in pieces this large. */
+  static constexpr VkDeviceSize CHUNK_SIZE = RING_SIZE / 4;
+
+  /* Everything that may read an uploaded buffer afterwards. */
+  static constexpr VkPipelineStageFlags READ_STAGES =
+      VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+      VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+  static constexpr VkAccessFlags READ_ACCESS =
+      VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT |
+      VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT |
+      VK_ACCESS_SHADER_READ_BIT;
+
+  void create(const VkDevice &device, Allocator &allocator,
+              uint32_t transferFamily, const VkQueue &transferQueue,
+              uint32_t graphicsFamily, const VkQueue &graphicsQueue,
+              Timeline &timeline, Profiler &profiler) {
+    this->device = device;
+    this->allocator = &allocator;
+    this->transferFamily = transferFamily;
+    this->transferQueue = transferQueue;
+    this->graphicsFamily = graphicsFamily;
+    this->graphicsQueue = graphicsQueue;
+    this->timeline = &timeline;
+    this->profiler = &profiler;
+
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = RING_SIZE;
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if (vkCreateBuffer(device, &bufferInfo, HostMemory::callbacks(),
+                       &staging) != VK_SUCCESS) {
+      throw std::runtime_error(
+          "[VkUploader]: Nowhere to stage things. Everything stays on the CPU.");
+    }
+    stagingMemory = allocator.allocate(staging,
+                                       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                           VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                       Strategy::Dedicated);
+
+    createPool(transferFamily, transferPool);
+    if (dedicated()) {
+      createPool(graphicsFamily, acquirePool);
+      transferTimeline.create(device);
+    }
+  }
+
+  /* Queues a copy of `size` bytes into `dst` at `dstOffset`. */
+  Ticket upload(const VkBuffer &dst, VkDeviceSize dstOffset, const void *data,
+                VkDeviceSize size) {
+    auto bytes = static_cast<const char *>(data);
+    for (VkDeviceSize done = 0; done < size; done += CHUNK_SIZE) {
+      VkDeviceSize chunk = std::min(CHUNK_SIZE, size - done);
+      VkDeviceSize offset = reserve(chunk);
+      memcpy(static_cast<char *>(stagingMemory.mapped) + offset, bytes + done,
+             (size_t)chunk);
+
+      VkBufferCopy region{};
+      region.srcOffset = offset;
+      region.dstOffset = dstOffset + done;
+      region.size = chunk;
+      pending.push_back({dst, region});
+    }
+    return {batch};
+  }
+
+  /* Submits everything queued so far in one go. */
+  Ticket flush() {
+    if (pending.empty()) {
+      return {batch - 1};
+    }
+
+    std::stable_sort(pending.begin(), pending.end(),
+                     [](const Copy &a, const Copy &b) { return a.dst < b.dst; });
+
+    Batch submitted{batch, 0, pendingBytes, VK_NULL_HANDLE, VK_NULL_HANDLE};
+    submitted.copies = begin(transferPool, freeCopies);
+
+    /* Timestamps are only calibrated for the graphics family, and the upload
+     * query slot is only reusable once its last batch landed. */
+    bool profiled = !dedicated() && timeline->reached(profiledValue);
+    if (profiled) {
+      profiler->begin(submitted.copies, profiler->uploadSlot());
+    }
+    {
+      std::optional<Profiler::Scope> scope;
+      if (profiled) {
+        scope.emplace(*profiler, submitted.copies, "upload");
+      }
+      record(submitted.copies);
+    }
+
+    if (!dedicated()) {
+      /* Make the copies visible to everything that reads buffers later on
+       * this queue. */
+      VkMemoryBarrier barrier{};
+      barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+      barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+      barrier.dstAccessMask = READ_ACCESS;
+      vkCmdPipelineBarrier(submitted.copies, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                           READ_STAGES, 0, 1, &barrier, 0, nullptr, 0,
+                           nullptr);
+      vkEndCommandBuffer(submitted.copies);
+
+      Submit submit;
+      submit.commands(submitted.copies);
+      submitted.value = timeline->submit(graphicsQueue, submit);
+      if (profiled) {
+        profiler->submitted(profiler->uploadSlot());
+        profiledValue = submitted.value;
+      }
+    } else {
+      /* Release on the copy engine... */
+      ownership(submitted.copies, VK_ACCESS_TRANSFER_WRITE_BIT, 0,
+                VK_PIPELINE_STAGE_TRANSFER_BIT,
+                VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+      vkEndCommandBuffer(submitted.copies);
+
+      Submit copy;
+      copy.commands(submitted.copies);
+      uint64_t copied = transferTimeline.submit(transferQueue, copy);
+
+      /* ...and acquire on graphics once the copies are through. */
+      submitted.acquire = begin(acquirePool, freeAcquires);
+      ownership(submitted.acquire, 0, READ_ACCESS,
+                VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, READ_STAGES);
+      vkEndCommandBuffer(submitted.acquire);
+
+      Submit acquire;
+      acquire.wait(transferTimeline.get(), READ_STAGES, copied);
+      acquire.commands(submitted.acquire);
+      submitted.value = timeline->submit(graphicsQueue, acquire);
+    }
+
+    inFlight.push_back(submitted);
+    pendingBytes = 0;
+    pending.clear();
+    return {batch++};
+  }
+
+  bool done(const Ticket &ticket) {
+    retire();
+    return ticket.batch <= retiredBatch;
+  }
+
+  void wait(const Ticket &ticket) {
+    if (ticket.batch == batch) {
+      flush();
+    }
+    while (!done(ticket)) {
+      timeline->wait(inFlight.front().value);
+    }
+  }
+
+  void clean() {
+    if (!inFlight.empty()) {
+      timeline->wait(inFlight.back().value);
+    }
+    retire();
+    profiler->collect(profiler->uploadSlot());
+    vkDestroyCommandPool(device, transferPool, HostMemory::callbacks());
+    if (dedicated()) {
+      vkDestroyCommandPool(device, acquirePool, HostMemory::callbacks());
+      transferTimeline.clean();
+    }
+    vkDestroyBuffer(device, staging, HostMemory::callbacks());
+    allocator->free(stagingMemory);
+  }
+
+private:
+  struct Copy {
+    VkBuffer dst;
+    VkBufferCopy region;
+  };
+
+  /* `value` is on the graphics timeline, the acquire half waits for the
+   * copies, so reaching it means both command buffers are free again. */
+  struct Batch {
+    uint64_t batch;
+    uint64_t value;
+    VkDeviceSize bytes;
+    VkCommandBuffer copies;
+    VkCommandBuffer acquire;
+  };
+
+  bool dedicated() const { return transferFamily != graphicsFamily; }
+
+  void createPool(uint32_t queueFamily, VkCommandPool &pool) {
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT |
+                     VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    poolInfo.queueFamilyIndex = queueFamily;
+    if (vkCreateCommandPool(device, &poolInfo, HostMemory::callbacks(),
+                            &pool) != VK_SUCCESS) {
+      throw std::runtime_error("[VkUploader]: Uh... I don't have a pool.!");
+    }
+  }
+
+  /* Finds room for `size` bytes in the ring, waiting on old batches if full. */
+  VkDeviceSize reserve(VkDeviceSize size) {
+    size = (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    while (true) {
+      retire();
+      if (used == 0) {
+        head = 0;
+      }
+      VkDeviceSize offset = head;
+      VkDeviceSize needed = size;
+      if (head + size > RING_SIZE) {
+        /* Skip the tail end of the ring, it comes back with this batch. */
+        needed += RING_SIZE - head;
+        offset = 0;
+      }
+      if (used + needed <= RING_SIZE) {
+        head = offset + size;
+        used += needed;
+        pendingBytes += needed;
+        return offset;
+      }
+
+      /* Full. Get our own pending bytes moving, then wait for the oldest. */
+      if (inFlight.empty()) {
+        flush();
+      }
+      timeline->wait(inFlight.front().value);
+    }
+  }
+
+  void record(const VkCommandBuffer &commandBuffer) {
+    std::vector<VkBufferCopy> regions;
+    for (size_t i = 0; i < pending.size();) {
+      regions.clear();
+      VkBuffer dst = pending[i].dst;
+      for (; i < pending.size() && pending[i].dst == dst; i++) {
+        regions.push_back(pending[i].region);
+      }
+      vkCmdCopyBuffer(commandBuffer, staging, dst,
+                      static_cast<uint32_t>(regions.size()), regions.data());
+    }
+  }
+
+  /* One half of the transfer->graphics handoff for every pending region.
+   * Both halves have to describe the exact same ranges. */
+  void ownership(const VkCommandBuffer &commandBuffer, VkAccessFlags srcAccess,
+                 VkAccessFlags dstAccess, VkPipelineStageFlags srcStage,
+                 VkPipelineStageFlags dstStage) {
+    barriers.clear();
+    for (const auto &copy : pending) {
+      VkBufferMemoryBarrier barrier{};
+      barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+      barrier.srcAccessMask = srcAccess;
+      barrier.dstAccessMask = dstAccess;
+      barrier.srcQueueFamilyIndex = transferFamily;
+      barrier.dstQueueFamilyIndex = graphicsFamily;
+      barrier.buffer = copy.dst;
+      barrier.offset = copy.region.dstOffset;
+      barrier.size = copy.region.size;
+      barriers.push_back(barrier);
+    }
+    vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 0, nullptr,
+                         static_cast<uint32_t>(barriers.size()),
+                         barriers.data(), 0, nullptr);
+  }
+
+  /* Recycles a finished command buffer from `pool`, or makes a new one. */
+  VkCommandBuffer begin(const VkCommandPool &pool,
+                        std::vector<VkCommandBuffer> &free) {
+    VkCommandBuffer commandBuffer;
+    if (!free.empty()) {
+      commandBuffer = free.back();
+      free.pop_back();
+      vkResetCommandBuffer(commandBuffer, 0);
+    } else {
+      VkCommandBufferAllocateInfo allocInfo{};
+      allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+      allocInfo.commandPool = pool;
+      allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+      allocInfo.commandBufferCount = 1;
+      if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) !=
+          VK_SUCCESS) {
+        throw std::runtime_error("[VkUploader]: Nothing to record the "
+                                 "copies into.");
+      }
+    }
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+    return commandBuffer;
+  }
+
+  /* Hands back ring space and command buffers of finished batches. */
+  void retire() {
+    while (!inFlight.empty() && timeline->reached(inFlight.front().value)) {
+      used -= inFlight.front().bytes;
+      retiredBatch = inFlight.front().batch;
+      freeCopies.push_back(inFlight.front().copies);
+      if (inFlight.front().acquire != VK_NULL_HANDLE) {
+        freeAcquires.push_back(inFlight.front().acquire);
+      }
+      inFlight.pop_front();
+    }
+  }
+
+  VkDevice device = VK_NULL_HANDLE;
+  Allocator *allocator = nullptr;
+  uint32_t transferFamily = 0;
+  VkQueue transferQueue = VK_NULL_HANDLE;
+  uint32_t graphicsFamily = 0;
+  VkQueue graphicsQueue = VK_NULL_HANDLE;
+  /* The graphics timeline belongs to the app, the copy engine's is ours. */
+  Timeline *timeline = nullptr;
+  Timeline transferTimeline;
+  Profiler *profiler = nullptr;
+  VkCommandPool transferPool = VK_NULL_HANDLE;
+  VkCommandPool acquirePool = VK_NULL_HANDLE;
+
+  VkBuffer staging = VK_NULL_HANDLE;
+  Memory stagingMemory;
+  VkDeviceSize head = 0;
+  VkDeviceSize used = 0;
+  VkDeviceSize pendingBytes = 0;
+
+  std::vector<Copy> pending;
+  std::vector<VkBufferMemoryBarrier> barriers;
+  std::deque<Batch> inFlight;
+  std::vector<VkCommandBuffer> freeCopies;
+  std::vector<VkCommandBuffer> freeAcquires;
+  /* The batch currently being filled, and the newest one known done. */
+  uint64_t batch = 1;
+  uint64_t retiredBatch = 0;
+  uint64_t profiledValue = 0;
+};
+
+#endif // UPLOADS_H_
@@ -1,6 +1,7 @@
 #ifndef VERTEX_H_
 #define VERTEX_H_
 
+#include "layout.hpp"
 #include <array>
 #include <cstddef>
 #include <cstdint>
@@ -13,32 +14,54 @@ struct Vertex {
   glm::vec2 pos;
   glm::vec3 color;
 
-  static VkVertexInputBindingDescription getBindingDescription() {
-    VkVertexInputBindingDescription bindingDescription{};
-    bindingDescription.binding = 0;
-    bindingDescription.stride = sizeof(Vertex);
-    bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+  static constexpr auto fields() {
+    return std::array{VERTEX_FIELD(Vertex, pos), VERTEX_FIELD(Vertex, color)};
+  }
+};
 
-    return bindingDescription;
+/* Vertex at 8 bytes instead of 20: snorm16 positions, unorm8 colours.
+ * Quantize::pack makes them from Vertex. */
+struct PackedVertex {
+  Normalized<glm::i16vec2> pos;
+  Normalized<glm::u8vec4> color;
+
+  static constexpr auto fields() {
+    return std::array{VERTEX_FIELD(PackedVertex, pos),
+                      VERTEX_FIELD(PackedVertex, color)};
   }
+};
+static_assert(sizeof(PackedVertex) == 8);
 
-  static std::array<VkVertexInputAttributeDescription, 2>
-  getAttributeDescriptions() {
-    std::array<VkVertexInputAttributeDescription, 2> attributeDescriptions{};
+/* Compact 3D vertex at 16 bytes: half positions with a spare w, an
+ * octahedral normal in two snorm16 (see Quantize::octahedral) and unorm8
+ * colours. Floats would take 36. */
+struct MeshVertex {
+  Half<4> pos;
+  Normalized<glm::i16vec2> normal;
+  Normalized<glm::u8vec4> color;
 
-    /* Position data */
-    attributeDescriptions[0].binding = 0;
-    attributeDescriptions[0].location = 0;
-    attributeDescriptions[0].format = VK_FORMAT_R32G32_SFLOAT;
-    attributeDescriptions[0].offset = offsetof(Vertex, pos);
+  static constexpr auto fields() {
+    return std::array{VERTEX_FIELD(MeshVertex, pos),
+                      VERTEX_FIELD(MeshVertex, normal),
+                      VERTEX_FIELD(MeshVertex, color)};
+  }
+};
+static_assert(sizeof(MeshVertex) == 16);
+
+/* Per instance data, advanced once per instance instead of per vertex. */
+struct Instance {
+  glm::vec2 offset;
+  glm::vec2 scale;
+  glm::vec3 color;
 
-    /* Color data */
-    attributeDescriptions[1].binding = 0;
-    attributeDescriptions[1].location = 1;
-    attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-    attributeDescriptions[1].offset = offsetof(Vertex, color);
+  static constexpr VkVertexInputRate RATE = VK_VERTEX_INPUT_RATE_INSTANCE;
+  /* Follows the vertices in VertexInput<Vertex, Instance>. */
+  static constexpr uint32_t BINDING = 1;
 
-    return attributeDescriptions;
+  static constexpr auto fields() {
+    return std::array{VERTEX_FIELD(Instance, offset),
+                      VERTEX_FIELD(Instance, scale),
+                      VERTEX_FIELD(Instance, color)};
   }
 };
 
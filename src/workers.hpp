@@ -0,0 +1,107 @@
+#ifndef WORKERS_H_
+#define WORKERS_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * A fixed set of threads that sleep until run() hands them a batch of jobs.
+ * run() is fork/join: it returns once every job is done, so callers never
+ * have to think about lifetimes of what the jobs touch.
+ * */
+class WorkerPool {
+public:
+  void create(uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+      threads.emplace_back([this] { work(); });
+    }
+  }
+
+  uint32_t size() const { return static_cast<uint32_t>(threads.size()); }
+
+  /* Calls job(0) .. job(count - 1) on the workers and waits for all of them.
+   * The first exception thrown by a job is rethrown here. */
+  void run(uint32_t count, const std::function<void(uint32_t)> &job) {
+    if (threads.empty()) {
+      for (uint32_t i = 0; i < count; i++) {
+        job(i);
+      }
+      return;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    this->job = &job;
+    next = 0;
+    total = count;
+    finished = 0;
+    wake.notify_all();
+    done.wait(lock, [this] { return finished == total; });
+    this->job = nullptr;
+
+    if (error) {
+      std::exception_ptr rethrow = error;
+      error = nullptr;
+      std::rethrow_exception(rethrow);
+    }
+  }
+
+  void clean() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wake.notify_all();
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    threads.clear();
+  }
+
+private:
+  void work() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      wake.wait(lock,
+                [this] { return stopping || (job != nullptr && next < total); });
+      if (stopping) {
+        return;
+      }
+      uint32_t index = next++;
+      const auto &current = *job;
+
+      lock.unlock();
+      try {
+        current(index);
+      } catch (...) {
+        lock.lock();
+        if (!error) {
+          error = std::current_exception();
+        }
+        lock.unlock();
+      }
+      lock.lock();
+
+      if (++finished == total) {
+        done.notify_all();
+      }
+    }
+  }
+
+  std::vector<std::thread> threads;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable done;
+  const std::function<void(uint32_t)> *job = nullptr;
+  uint32_t next = 0;
+  uint32_t total = 0;
+  uint32_t finished = 0;
+  bool stopping = false;
+  std::exception_ptr error;
+};
+
+#endif // WORKERS_H_